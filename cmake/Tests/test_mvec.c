@@ -0,0 +1,17 @@
+#include <math.h>
+
+#pragma omp declare simd notinbranch
+double exp( double );
+#pragma omp declare simd notinbranch
+double log( double );
+
+
+int main(int argc, char ** argv) {
+  double values[64];
+
+#pragma omp simd
+  for (int i = 0; i < 64; i++)
+    values[i] = exp( log( argc + i ));
+
+  return (values[0] > 0) ? 0 : 1;
+}
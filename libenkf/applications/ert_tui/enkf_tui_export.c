@@ -25,69 +25,200 @@
 #include <ert/util/util.h>
 #include <ert/util/menu.h>
 #include <ert/util/msg.h>
+#include <ert/util/arg_pack.h>
+#include <ert/util/thread_pool.h>
+#include <ert/util/stringlist.h>
+#include <ert/util/double_vector.h>
+#include <ert/util/int_vector.h>
 
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/field.h>
 #include <ert/enkf/field_config.h>
 #include <ert/enkf/enkf_state.h>
 #include <ert/enkf/enkf_fs.h>
+#include <ert/enkf/enkf_node.h>
 #include <ert/enkf/field_config.h>
 #include <ert/enkf/gen_data.h>
 #include <ert/enkf/gen_data_config.h>
 
+#include <ert/ecl/ecl_type.h>
+
 #include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
+#include <enkf_tui_stat.h>
+#include <enkf_tui_kernel.h>
 #include <enkf_tui_help.h>
 #define PROMPT_LEN  60
 
 
+/**
+   The export of fields is multithreaded over the realizations. Each
+   worker thread handles the realizations iens1 + ithread, iens1 +
+   ithread + num_threads, ... and allocates one enkf_node instance per
+   field key which is reused for all the realizations it exports. Each
+   (key, realization) is loaded from the filesystem once and then
+   written to all the requested output formats. The output directories
+   are created by the calling thread before the workers are started.
+
+   The export paths are formatted with the realization number as
+   first argument and the field key as second argument, i.e. the
+   path formats can be like 'export/%d/%s.roff'.
+*/
+
+static void * enkf_tui_export_field_mt( void * arg ) {
+  arg_pack_type * arg_pack                       = arg_pack_safe_cast( arg );
+  const enkf_config_node_type ** config_nodes    = arg_pack_iget_ptr( arg_pack , 0 );
+  enkf_fs_type * fs                              = arg_pack_iget_ptr( arg_pack , 1 );
+  const field_file_format_type * file_types      = arg_pack_iget_const_ptr( arg_pack , 2 );
+  path_fmt_type ** export_paths                  = arg_pack_iget_ptr( arg_pack , 3 );
+  enkf_tui_progress_type * progress              = arg_pack_iget_ptr( arg_pack , 4 );
+  int num_keys                                   = arg_pack_iget_int( arg_pack , 5 );
+  int num_formats                                = arg_pack_iget_int( arg_pack , 6 );
+  int report_step                                = arg_pack_iget_int( arg_pack , 7 );
+  int iens1                                      = arg_pack_iget_int( arg_pack , 8 );
+  int iens2                                      = arg_pack_iget_int( arg_pack , 9 );
+  int iens_step                                  = arg_pack_iget_int( arg_pack , 10 );
+  const bool output_transform                    = true;
+  enkf_node_type ** nodes                        = util_calloc( num_keys , sizeof * nodes );
+  int iens , ikey;
+
+  for (ikey = 0; ikey < num_keys; ikey++)
+    nodes[ikey] = enkf_node_alloc( config_nodes[ikey] );
+
+  for (iens = iens1; iens <= iens2; iens += iens_step) {
+    node_id_type node_id = {.report_step = report_step , .iens = iens };
+    size_t bytes = 0;
+
+    for (ikey = 0; ikey < num_keys; ikey++) {
+      const char * key = enkf_config_node_get_key( config_nodes[ikey] );
+      enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "export_field" , key , iens );
+      size_t key_bytes = 0;
+
+      if (enkf_node_try_load(nodes[ikey] , fs , node_id)) {
+        const field_type * field = enkf_node_value_ptr(nodes[ikey]);
+
+        for (int iformat = 0; iformat < num_formats; iformat++) {
+          char * filename = path_fmt_alloc_path( export_paths[iformat] , false , iens , key );
+          field_export(field , filename , NULL , file_types[iformat] , output_transform, NULL);
+          key_bytes += util_file_size( filename );
+          free(filename);
+        }
+      } else
+        printf("Warning: could not load %s for realization:%d \n", key , iens);
+
+      enkf_tui_trace_span_add_bytes( span , 0 , key_bytes );
+      enkf_tui_trace_span_end( span );
+      bytes += key_bytes;
+    }
+    enkf_tui_progress_update( progress , 1 , bytes );
+  }
+
+  for (ikey = 0; ikey < num_keys; ikey++)
+    enkf_node_free( nodes[ikey] );
+  free( nodes );
+  return NULL;
+}
+
+
+static void enkf_tui_export_fields__(const enkf_main_type * enkf_main ,
+                                     int num_keys , const enkf_config_node_type ** config_nodes ,
+                                     int num_formats , const field_file_format_type * file_types , path_fmt_type ** export_paths ,
+                                     int report_step , int iens1 , int iens2) {
+
+  /* Create all the output directories up front. */
+  for (int iformat = 0; iformat < num_formats; iformat++) {
+    for (int ikey = 0; ikey < num_keys; ikey++) {
+      for (int iens = iens1; iens <= iens2; iens++) {
+        char * filename = path_fmt_alloc_path( export_paths[iformat] , false , iens , enkf_config_node_get_key( config_nodes[ikey] ));
+        char * path;
+        util_alloc_file_components(filename , &path , NULL , NULL);
+        if (path != NULL) {
+          util_make_path( path );
+          free( path );
+        }
+        free( filename );
+      }
+    }
+  }
+
+  {
+    enkf_fs_type   * fs              = enkf_main_tui_get_fs(enkf_main);
+    int num_threads                  = util_int_min( enkf_tui_util_get_num_threads( ) , iens2 - iens1 + 1 );
+    thread_pool_type * tp            = thread_pool_alloc( num_threads , true );
+    arg_pack_type ** arg_list        = util_calloc( num_threads , sizeof * arg_list );
+    enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Exporting: " , iens2 - iens1 + 1 );
+    int ithread;
+
+    for (ithread = 0; ithread < num_threads; ithread++) {
+      arg_list[ithread] = arg_pack_alloc( );
+      arg_pack_append_ptr( arg_list[ithread] , config_nodes );
+      arg_pack_append_ptr( arg_list[ithread] , fs );
+      arg_pack_append_const_ptr( arg_list[ithread] , file_types );
+      arg_pack_append_ptr( arg_list[ithread] , export_paths );
+      arg_pack_append_ptr( arg_list[ithread] , progress );
+      arg_pack_append_int( arg_list[ithread] , num_keys );
+      arg_pack_append_int( arg_list[ithread] , num_formats );
+      arg_pack_append_int( arg_list[ithread] , report_step );
+      arg_pack_append_int( arg_list[ithread] , iens1 + ithread );
+      arg_pack_append_int( arg_list[ithread] , iens2 );
+      arg_pack_append_int( arg_list[ithread] , num_threads );
+
+      thread_pool_add_job( tp , enkf_tui_export_field_mt , arg_list[ithread] );
+    }
+    thread_pool_join( tp );
+
+    enkf_tui_progress_free( progress );
+    for (ithread = 0; ithread < num_threads; ithread++)
+      arg_pack_free( arg_list[ithread] );
+    free( arg_list );
+    thread_pool_free( tp );
+  }
+}
+
+
+/**
+   Returns NULL if no filename is entered. When several keys are
+   exported the filename must contain %s for the key, otherwise the
+   keys would overwrite each other.
+*/
+
+static path_fmt_type * enkf_tui_export_scanf_path_fmt( const char * prompt , bool require_key ) {
+  path_fmt_type * export_path = NULL;
+  char * path_fmt;
+
+  do {
+    util_printf_prompt(prompt , PROMPT_LEN , '=' , "=> ");
+    path_fmt = util_alloc_stdin_line();
+    if (path_fmt != NULL) {
+      if (require_key && (strstr( path_fmt , "%s" ) == NULL))
+        printf("Several keys are exported - the filename must contain %%s for the key.\n");
+      else
+        export_path = path_fmt_alloc_path_fmt( path_fmt );
+      free( path_fmt );
+    }
+  } while ((path_fmt != NULL) && (export_path == NULL));
+
+  return export_path;
+}
+
+
 void enkf_tui_export_field(const enkf_main_type * enkf_main , field_file_format_type file_type) {
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
-  const bool output_transform = true;
   const enkf_config_node_type * config_node;
   const int last_report = enkf_main_get_history_length( enkf_main );
-  int        iens1 , iens2 , iens , report_step;
+  int        iens1 , iens2 , report_step;
   path_fmt_type * export_path;
   
   config_node    = enkf_tui_util_scanf_key(ensemble_config , PROMPT_LEN ,  FIELD  , INVALID_VAR );
 
   report_step = util_scanf_int_with_limits("Report step: ", PROMPT_LEN , 0 , last_report);
   enkf_tui_util_scanf_iens_range("Realizations members to export(0 - %d)" , enkf_main_get_ensemble_size( enkf_main ) , PROMPT_LEN , &iens1 , &iens2);
+  export_path = enkf_tui_export_scanf_path_fmt("Filename to store files in (with %d) in: " , false);
 
-  {
-    char * path_fmt;
-    util_printf_prompt("Filename to store files in (with %d) in: " , PROMPT_LEN , '=' , "=> ");
-    path_fmt = util_alloc_stdin_line();
-    export_path = path_fmt_alloc_path_fmt( path_fmt );
-    free( path_fmt );
+  if (export_path != NULL) {
+    enkf_tui_export_fields__( enkf_main , 1 , &config_node , 1 , &file_type , &export_path , report_step , iens1 , iens2 );
+    path_fmt_free( export_path );
   }
-  
-  {
-    enkf_fs_type   * fs   = enkf_main_tui_get_fs(enkf_main);
-    enkf_node_type * node = enkf_node_alloc(config_node);
-
-    for (iens = iens1; iens <= iens2; iens++) {
-      node_id_type node_id = {.report_step = report_step , .iens = iens };
-      if (enkf_node_try_load(node , fs , node_id)) {
-        char * filename = path_fmt_alloc_path( export_path , false , iens);
-        {
-          char * path;
-          util_alloc_file_components(filename , &path , NULL , NULL);
-          if (path != NULL) {
-            util_make_path( path );
-            free( path );
-          }
-        }
-
-        {
-          const field_type * field = enkf_node_value_ptr(node);
-          field_export(field , filename , NULL , file_type , output_transform, NULL);
-        }
-        free(filename);
-      } else 
-        printf("Warning: could not load realization:%d \n", iens);
-    } 
-    enkf_node_free(node);
-  } 
 }
 
 
@@ -112,6 +243,115 @@ void enkf_tui_export_restart_all(void * enkf_main) {
 }
 
 
+/**
+   Export several fields to several formats in one pass; each field
+   is loaded once per realization and written to all the selected
+   formats. The formats are given as a list of the names below, and
+   one filename format is prompted for each of them.
+*/
+
+#define NUM_EXPORT_FORMATS 4
+
+void enkf_tui_export_fields_multi(void * arg) {
+  enkf_main_type * enkf_main = enkf_main_safe_cast( arg );
+  const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
+  const char * format_names[NUM_EXPORT_FORMATS]             = {"roff" , "grdecl" , "active" , "all"};
+  const field_file_format_type format_types[NUM_EXPORT_FORMATS] = {RMS_ROFF_FILE , ECL_GRDECL_FILE , ECL_KW_FILE_ACTIVE_CELLS , ECL_KW_FILE_ALL_CELLS};
+  stringlist_type * keys = stringlist_alloc_new();
+  int_vector_type * formats = int_vector_alloc( 0 , 0 );
+
+  {
+    char * input;
+    util_printf_prompt("Fields to export (KEY1 KEY2 ...)" , PROMPT_LEN , '=' , "=> ");
+    input = util_alloc_stdin_line();
+    if (input != NULL) {
+      int num_input;
+      char ** input_list;
+      util_split_string( input , " " , &num_input , &input_list );
+      for (int i = 0; i < num_input; i++) {
+        if (ensemble_config_has_key( ensemble_config , input_list[i] ) &&
+            (enkf_config_node_get_impl_type( ensemble_config_get_node( ensemble_config , input_list[i] )) == FIELD)) {
+          if (!stringlist_contains( keys , input_list[i] ))
+            stringlist_append_copy( keys , input_list[i] );
+        } else
+          fprintf(stderr,"Sorry - %s is not a FIELD key.\n",input_list[i]);
+      }
+      util_free_stringlist( input_list , num_input );
+      free( input );
+    }
+  }
+
+  if (stringlist_get_size( keys ) > 0) {
+    char * input;
+    util_printf_prompt("Formats (roff grdecl active all)" , PROMPT_LEN , '=' , "=> ");
+    input = util_alloc_stdin_line();
+    if (input != NULL) {
+      int num_input;
+      char ** input_list;
+      util_split_string( input , " " , &num_input , &input_list );
+      for (int i = 0; i < num_input; i++) {
+        int iformat;
+        for (iformat = 0; iformat < NUM_EXPORT_FORMATS; iformat++)
+          if (util_string_equal( input_list[i] , format_names[iformat] ))
+            break;
+
+        if (iformat == NUM_EXPORT_FORMATS)
+          fprintf(stderr,"Sorry - unknown format:%s\n",input_list[i]);
+        else if (!int_vector_contains( formats , iformat ))
+          int_vector_append( formats , iformat );
+      }
+      util_free_stringlist( input_list , num_input );
+      free( input );
+    }
+  }
+
+  if ((stringlist_get_size( keys ) > 0) && (int_vector_size( formats ) > 0)) {
+    const int last_report = enkf_main_get_history_length( enkf_main );
+    int num_keys          = stringlist_get_size( keys );
+    int num_formats       = int_vector_size( formats );
+    const enkf_config_node_type ** config_nodes = util_calloc( num_keys , sizeof * config_nodes );
+    field_file_format_type * file_types         = util_calloc( num_formats , sizeof * file_types );
+    path_fmt_type ** export_paths               = util_calloc( num_formats , sizeof * export_paths );
+    bool paths_ok = true;
+    int iens1 , iens2 , report_step;
+
+    for (int ikey = 0; ikey < num_keys; ikey++)
+      config_nodes[ikey] = ensemble_config_get_node( ensemble_config , stringlist_iget( keys , ikey ));
+
+    report_step = util_scanf_int_with_limits("Report step: ", PROMPT_LEN , 0 , last_report);
+    enkf_tui_util_scanf_iens_range("Realizations members to export(0 - %d)" , enkf_main_get_ensemble_size( enkf_main ) , PROMPT_LEN , &iens1 , &iens2);
+
+    for (int i = 0; i < num_formats; i++) {
+      int iformat = int_vector_iget( formats , i );
+      char * prompt = util_alloc_sprintf("%s files (with %%d%s): " , format_names[iformat] , (num_keys > 1) ? " and %s" : "");
+      file_types[i]   = format_types[iformat];
+      export_paths[i] = enkf_tui_export_scanf_path_fmt( prompt , num_keys > 1 );
+      free( prompt );
+      if (export_paths[i] == NULL) {
+        paths_ok = false;
+        break;
+      }
+    }
+
+    if (paths_ok)
+      enkf_tui_export_fields__( enkf_main , num_keys , config_nodes , num_formats , file_types , export_paths , report_step , iens1 , iens2 );
+
+    for (int i = 0; i < num_formats; i++) {
+      if (export_paths[i] != NULL)
+        path_fmt_free( export_paths[i] );
+    }
+    free( export_paths );
+    free( file_types );
+    free( config_nodes );
+  }
+
+  int_vector_free( formats );
+  stringlist_free( keys );
+}
+
+#undef NUM_EXPORT_FORMATS
+
+
 void enkf_tui_export_gen_data(void * arg) {
   enkf_main_type * enkf_main = enkf_main_safe_cast( arg );
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
@@ -243,22 +483,15 @@ void enkf_tui_export_profile(void * enkf_main) {
           if (report_active[report_step]) {
             for (iens = iens1; iens <= iens2; iens++) {              
               node_id_type node_id = {.report_step = report_step , .iens = iens };
-              if (enkf_node_try_load(node , fs, node_id)) {
-                {
-                  const field_type * field = enkf_node_value_ptr( node );
-                  int field_index;
-                  for (field_index = 0 ; field_index < total_cells; field_index++)
-                    profile[field_index] = field_iget_double(field , cell_list[field_index]);
-                  {
-                    char * filename = path_fmt_alloc_file(file_fmt , true , report_step , iens);
-                    FILE * stream = util_fopen(filename , "w");
-                    for (field_index = 0; field_index < total_cells; field_index++)
-                      fprintf(stream, "%d  %g\n",field_index , profile[field_index]);
-                    
-                    fclose(stream);
-                    free(filename);
-                  }                           
-                }
+              if (enkf_tui_util_load_field_cells(fs , node , node_id , total_cells , cell_list , profile)) {
+                int field_index;
+                char * filename = path_fmt_alloc_file(file_fmt , true , report_step , iens);
+                FILE * stream = util_fopen(filename , "w");
+                for (field_index = 0; field_index < total_cells; field_index++)
+                  fprintf(stream, "%d  %g\n",field_index , profile[field_index]);
+                
+                fclose(stream);
+                free(filename);
               } else 
                 fprintf(stderr," ** Warning field:%s is missing for member,report: %d,%d \n",enkf_config_node_get_key(config_node) , iens , report_step);
             }
@@ -301,16 +534,15 @@ void enkf_tui_export_cell(void * enkf_main) {
       
       for (report_step = 0; report_step <= last_report; report_step++) {
         if (report_active[report_step]) {
+          /*
+             As before a report step is only exported if the first
+             member has the field; the first load doubles as the probe.
+          */
           node_id_type node_id = {.report_step = report_step , .iens = iens1 };
-          if (enkf_node_try_load(node , fs , node_id)) {
-            for (iens = iens1; iens <= iens2; iens++) {
+          if (enkf_tui_util_load_field_cells(fs , node , node_id , 1 , &cell_nr , &cell_data[iens1])) {
+            for (iens = iens1 + 1; iens <= iens2; iens++) {
               node_id.iens = iens;
-              if (enkf_node_try_load(node , fs , node_id )) {
-                {
-                  const field_type * field = enkf_node_value_ptr( node );
-                  cell_data[iens] = field_iget_double(field , cell_nr);
-                }
-              } else {
+              if (!enkf_tui_util_load_field_cells(fs , node , node_id , 1 , &cell_nr , &cell_data[iens])) {
                 fprintf(stderr," ** Warning field:%s is missing for member,report: %d,%d \n",enkf_config_node_get_key(config_node) , iens , report_step);
                 cell_data[iens] = -1;
               }
@@ -392,6 +624,58 @@ void enkf_tui_export_time(void * enkf_main) {
 
 /*****************************************************************/
 
+/**
+   The indicator sum for P( a =< x < b ) is computed as a streaming
+   reduction: each worker thread loads the realizations iens1 +
+   ithread, iens1 + ithread + num_threads, ... one at a time and
+   accumulates into its own partial sum; the partial sums are merged
+   when all the workers have completed. The peak memory is therefor
+   two fields per thread, independent of the ensemble size.
+*/
+
+/**
+   Each worker thread accumulates the indicator sum for its
+   realizations in a private array; the field values are copied to a
+   plain double array, the output transform is applied, and the
+   indicator is summed with the kernels from enkf_tui_kernel.
+*/
+
+static void * enkf_tui_export_fieldP_mt( void * arg ) {
+  arg_pack_type * arg_pack                  = arg_pack_safe_cast( arg );
+  const enkf_config_node_type * config_node = arg_pack_iget_const_ptr( arg_pack , 0 );
+  enkf_fs_type * fs                         = arg_pack_iget_ptr( arg_pack , 1 );
+  double * sum                              = arg_pack_iget_ptr( arg_pack , 2 );
+  int * active_count                        = arg_pack_iget_ptr( arg_pack , 3 );
+  enkf_tui_progress_type * progress         = arg_pack_iget_ptr( arg_pack , 4 );
+  int report_step                           = arg_pack_iget_int( arg_pack , 5 );
+  int iens1                                 = arg_pack_iget_int( arg_pack , 6 );
+  int iens2                                 = arg_pack_iget_int( arg_pack , 7 );
+  int iens_step                             = arg_pack_iget_int( arg_pack , 8 );
+  double lower_limit                        = arg_pack_iget_double( arg_pack , 9 );
+  double upper_limit                        = arg_pack_iget_double( arg_pack , 10 );
+  const field_config_type * field_config    = enkf_config_node_get_ref( config_node );
+  const int data_size                       = field_config_get_data_size( field_config );
+  enkf_node_type * node                     = enkf_node_alloc( config_node );
+  double * values                           = util_calloc( data_size , sizeof * values );
+  int iens;
+
+  for (iens = iens1; iens < iens2; iens += iens_step) {
+    node_id_type node_id = {.report_step = report_step , .iens = iens };
+    if (enkf_node_try_load( node , fs , node_id )) {
+      enkf_tui_kernel_load_field( enkf_node_value_ptr( node ) , data_size , values );
+      enkf_tui_kernel_output_transform( field_config , data_size , values );
+      enkf_tui_kernel_indicator_sum( data_size , values , lower_limit , upper_limit , sum );
+      (*active_count)++;
+    }
+    enkf_tui_progress_update( progress , 1 , 0 );
+  }
+
+  free( values );
+  enkf_node_free( node );
+  return NULL;
+}
+
+
 void enkf_tui_export_fieldP(void * arg) {
   enkf_main_type * enkf_main                   = enkf_main_safe_cast( arg ); 
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
@@ -406,26 +690,58 @@ void enkf_tui_export_fieldP(void * arg) {
   util_printf_prompt("Filename to store file: " , PROMPT_LEN , '=' , "=> ");
   export_file = util_alloc_stdin_line();
   {
-    enkf_fs_type   * fs        = enkf_main_tui_get_fs(enkf_main);
-    enkf_node_type ** ensemble = enkf_node_load_alloc_ensemble( config_node , fs , report_step , iens1 , iens2 );
-    enkf_node_type *  sum      = enkf_node_alloc( config_node );
-    int active_ens_size        = 0;
-    int iens;
-    
-    enkf_node_clear( sum );
+    enkf_fs_type   * fs               = enkf_main_tui_get_fs(enkf_main);
+    int num_threads                   = util_int_max( 1 , util_int_min( enkf_tui_util_get_num_threads( ) , iens2 - iens1 ));
+    thread_pool_type * tp             = thread_pool_alloc( num_threads , true );
+    arg_pack_type ** arg_list         = util_calloc( num_threads , sizeof * arg_list );
+    const int data_size               = field_config_get_data_size( enkf_config_node_get_ref( config_node ));
+    double ** partial_sum             = util_calloc( num_threads , sizeof * partial_sum );
+    int * active_count                = util_calloc( num_threads , sizeof * active_count );
+    enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Loading: " , iens2 - iens1 );
+    int active_ens_size               = 0;
+    int ithread;
+
+    for (ithread = 0; ithread < num_threads; ithread++) {
+      partial_sum[ithread]  = util_calloc( data_size , sizeof * partial_sum[ithread] );
+      active_count[ithread] = 0;
+
+      arg_list[ithread] = arg_pack_alloc( );
+      arg_pack_append_const_ptr( arg_list[ithread] , config_node );
+      arg_pack_append_ptr( arg_list[ithread] , fs );
+      arg_pack_append_ptr( arg_list[ithread] , partial_sum[ithread] );
+      arg_pack_append_ptr( arg_list[ithread] , &active_count[ithread] );
+      arg_pack_append_ptr( arg_list[ithread] , progress );
+      arg_pack_append_int( arg_list[ithread] , report_step );
+      arg_pack_append_int( arg_list[ithread] , iens1 + ithread );
+      arg_pack_append_int( arg_list[ithread] , iens2 );
+      arg_pack_append_int( arg_list[ithread] , num_threads );
+      arg_pack_append_double( arg_list[ithread] , lower_limit );
+      arg_pack_append_double( arg_list[ithread] , upper_limit );
+
+      thread_pool_add_job( tp , enkf_tui_export_fieldP_mt , arg_list[ithread] );
+    }
+    thread_pool_join( tp );
+    enkf_tui_progress_free( progress );
+
     {
-      /* OK going low level */
-      field_type * sum_field = enkf_node_value_ptr( sum );
-
-      for (iens = iens1; iens < iens2; iens++) {
-        if (ensemble[iens - iens1] != NULL) {
-          field_type * field     = enkf_node_value_ptr( ensemble[iens - iens1] );
-          field_update_sum( sum_field , field , lower_limit , upper_limit);
-          active_ens_size++;
-        }
+      double * sum = partial_sum[0];
+
+      for (ithread = 0; ithread < num_threads; ithread++) {
+        if (ithread > 0)
+          enkf_tui_kernel_iadd( data_size , sum , partial_sum[ithread] );
+        active_ens_size += active_count[ithread];
       }
+
       if (active_ens_size > 0) {
-        field_scale( sum_field , 1.0 / active_ens_size );
+        enkf_node_type * sum_node = enkf_node_alloc( config_node );
+        field_type * sum_field    = enkf_node_value_ptr( sum_node );
+        int * index_list          = util_calloc( data_size , sizeof * index_list );
+
+        enkf_tui_kernel_scale( data_size , sum , 1.0 / active_ens_size );
+        for (int i = 0; i < data_size; i++)
+          index_list[i] = i;
+        field_indexed_set( sum_field , ECL_DOUBLE , data_size , index_list , sum );
+        free( index_list );
         {
           char * path;
           util_alloc_file_components( export_file , &path , NULL , NULL);
@@ -435,27 +751,175 @@ void enkf_tui_export_fieldP(void * arg) {
           }
         }
         field_export(sum_field , export_file , NULL , RMS_ROFF_FILE , false, NULL);
+        enkf_node_free( sum_node );
       } else fprintf(stderr,"Warning: no data found \n");
     }    
     
-    for (iens = iens1; iens < iens2; iens++) {
-      if (ensemble[iens - iens1] != NULL)
-        enkf_node_free( ensemble[iens - iens1] );
+    for (ithread = 0; ithread < num_threads; ithread++) {
+      free( partial_sum[ithread] );
+      arg_pack_free( arg_list[ithread] );
     }
-
-    free( ensemble );
-    enkf_node_free( sum );
+    free( partial_sum );
+    free( active_count );
+    free( arg_list );
+    thread_pool_free( tp );
   }
   free( export_file );
 }
 
 
+/**
+   Exports per cell ensemble statistics of a field: mean, standard
+   deviation and a list of percentiles. The statistics are accumulated
+   with enkf_tui_stat in one pass over the realizations, so only one
+   realization is held in memory at a time. The statistics are
+   computed from the field values as stored, i.e. before any output
+   transform, and the fields are exported without output transform.
+
+   The filename must contain one %s which is replaced with the name of
+   the statistic, i.e. MEAN, STD, P10, P50, ...
+*/
+
+static void enkf_tui_export_field_stat_export( const enkf_config_node_type * config_node , int data_size , const int * index_list , const double * values , const char * file_fmt , const char * stat_name , field_file_format_type file_type) {
+  enkf_node_type * node = enkf_node_alloc( config_node );
+  field_type * field    = enkf_node_value_ptr( node );
+  char * filename       = util_alloc_sprintf( file_fmt , stat_name );
+
+  field_indexed_set( field , ECL_DOUBLE , data_size , index_list , values );
+  field_export( field , filename , NULL , file_type , false , NULL );
+  printf("Wrote: %s \n", filename );
+
+  free( filename );
+  enkf_node_free( node );
+}
+
+
+void enkf_tui_export_field_stat(void * arg) {
+  enkf_main_type * enkf_main                   = enkf_main_safe_cast( arg );
+  const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
+  const enkf_config_node_type * config_node    = enkf_tui_util_scanf_key(ensemble_config , PROMPT_LEN ,  FIELD  , INVALID_VAR );
+  const field_config_type * field_config       = enkf_config_node_get_ref( config_node );
+  const int last_report                        = enkf_main_get_history_length( enkf_main );
+  int report_step                              = util_scanf_int_with_limits("Report step: ", PROMPT_LEN , 0 , last_report);
+  int file_format                              = util_scanf_int_with_limits("File format (1: RMS Roff  2: ECLIPSE grdecl)", PROMPT_LEN , 1 , 2);
+  field_file_format_type file_type             = (file_format == 1) ? RMS_ROFF_FILE : ECL_GRDECL_FILE;
+  double_vector_type * quantiles               = double_vector_alloc( 0 , 0 );
+  int iens1 , iens2;
+  char * file_fmt;
+
+  enkf_tui_util_scanf_iens_range("Realizations members to use(0 - %d)" , enkf_main_get_ensemble_size( enkf_main ) , PROMPT_LEN , &iens1 , &iens2);
+  {
+    char * input;
+    util_printf_prompt("Percentiles (blank: 10 50 90)" , PROMPT_LEN , '=' , "=> ");
+    input = util_alloc_stdin_line();
+    if (input != NULL) {
+      int num_tokens , i;
+      char ** tokens;
+      util_split_string( input , " ," , &num_tokens , &tokens );
+      for (i = 0; i < num_tokens; i++) {
+        double percentile;
+        if (util_sscanf_double( tokens[i] , &percentile ) && (percentile >= 0) && (percentile <= 100))
+          double_vector_append( quantiles , percentile / 100 );
+        else
+          fprintf(stderr,"** Warning: ignoring invalid percentile: %s \n", tokens[i]);
+      }
+      util_free_stringlist( tokens , num_tokens );
+      free( input );
+    } else {
+      double_vector_append( quantiles , 0.10 );
+      double_vector_append( quantiles , 0.50 );
+      double_vector_append( quantiles , 0.90 );
+    }
+  }
+
+  while (true) {
+    char * percent_ptr;
+    util_printf_prompt("Filename to store files in (with %s for MEAN/STD/P10/...)" , PROMPT_LEN , '=' , "=> ");
+    file_fmt    = util_alloc_stdin_line();
+    if (file_fmt == NULL) {
+      /* No filename, or end of input - nothing is exported. */
+      double_vector_free( quantiles );
+      return;
+    }
+
+    percent_ptr = strchr( file_fmt , '%' );
+    if (percent_ptr != NULL && percent_ptr[1] == 's' && strchr( percent_ptr + 1 , '%') == NULL)
+      break;
+    
+    printf("The filename must contain exactly one %%s \n");
+    util_safe_free( file_fmt );
+  }
+
+  {
+    char * path;
+    util_alloc_file_components( file_fmt , &path , NULL , NULL);
+    if (path != NULL) {
+      util_make_path( path );
+      free( path );
+    }
+  }
+
+  {
+    enkf_fs_type * fs                 = enkf_main_tui_get_fs( enkf_main );
+    const int data_size               = field_config_get_data_size( field_config );
+    enkf_tui_stat_type * stat         = enkf_tui_stat_alloc( data_size , quantiles );
+    enkf_node_type * node             = enkf_node_alloc( config_node );
+    enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Loading: " , iens2 - iens1 + 1 );
+    int iens;
+
+    for (iens = iens1; iens <= iens2; iens++) {
+      node_id_type node_id = {.report_step = report_step , .iens = iens };
+      if (enkf_node_try_load( node , fs , node_id ))
+        enkf_tui_stat_add_field( stat , enkf_node_value_ptr( node ));
+      else
+        fprintf(stderr," ** Warning field:%s is missing for member,report: %d,%d \n",enkf_config_node_get_key(config_node) , iens , report_step);
+
+      enkf_tui_progress_update( progress , 1 , 0 );
+    }
+    enkf_tui_progress_free( progress );
+    enkf_node_free( node );
+
+    if (enkf_tui_stat_get_count( stat ) > 0) {
+      double * values   = util_calloc( data_size , sizeof * values );
+      int * index_list  = util_calloc( data_size , sizeof * index_list );
+      int i , iq;
+
+      for (i = 0; i < data_size; i++)
+        index_list[i] = i;
+
+      enkf_tui_stat_get_mean( stat , values );
+      enkf_tui_export_field_stat_export( config_node , data_size , index_list , values , file_fmt , "MEAN" , file_type );
+
+      enkf_tui_stat_get_std( stat , values );
+      enkf_tui_export_field_stat_export( config_node , data_size , index_list , values , file_fmt , "STD" , file_type );
+
+      for (iq = 0; iq < enkf_tui_stat_get_num_quantiles( stat ); iq++) {
+        char * stat_name = util_alloc_sprintf("P%g" , 100 * enkf_tui_stat_iget_quantile_value( stat , iq ));
+        enkf_tui_stat_iget_quantile( stat , iq , values );
+        enkf_tui_export_field_stat_export( config_node , data_size , index_list , values , file_fmt , stat_name , file_type );
+        free( stat_name );
+      }
+
+      free( index_list );
+      free( values );
+    } else 
+      fprintf(stderr,"Warning: no data found \n");
+
+    enkf_tui_stat_free( stat );
+  }
+  free( file_fmt );
+  double_vector_free( quantiles );
+}
+
+
 /*****************************************************************/
 
 
 /**
-   This is a very simple function for exporting a scalar value for all
-   member/report steps to a CSV file. The file is characterized by:
+   This is a very simple function for exporting scalar values for all
+   member/report steps to a CSV file. Several scalars can be exported
+   in one go by entering several KEY:INDEX values separated by space;
+   the columns are then grouped by key. The file is characterized by:
 
     * Missing elements are represented with an empty string.
 
@@ -479,24 +943,136 @@ void enkf_tui_export_fieldP(void * arg) {
   
       Finally you are asked where in the excel workbook you want to
       insert the data.
+
+   The data is assembled in a step-major table in memory before the
+   file is written; each (key, realization) vector is loaded from the
+   enkf_fs instance only once.
 */
 
 
 #define CSV_NEWLINE        "\r\n"
 #define CSV_MISSING_VALUE  ""
 #define CSV_SEP            ","
+#define CSV_BUFFER_SIZE    (1 << 20)
+
+
+typedef struct {
+  int      num_steps;
+  int      num_columns;
+  double * data;        /* data[ step * num_columns + column ] */
+  bool   * valid;
+} csv_table_type;
+
+
+static csv_table_type * csv_table_alloc( int num_steps , int num_columns ) {
+  csv_table_type * table = util_malloc( sizeof * table );
+  table->num_steps   = num_steps;
+  table->num_columns = num_columns;
+  table->data        = util_calloc( num_steps * num_columns , sizeof * table->data );
+  table->valid       = util_calloc( num_steps * num_columns , sizeof * table->valid );
+  return table;
+}
+
+
+static void csv_table_free( csv_table_type * table ) {
+  free( table->data );
+  free( table->valid );
+  free( table );
+}
+
+
+static void csv_table_iset( csv_table_type * table , int step , int column , double value ) {
+  table->data[ step * table->num_columns + column ]  = value;
+  table->valid[ step * table->num_columns + column ] = true;
+}
+
+
+/*
+  Fills one column of the table with the time series of one
+  realization. For nodes with vector storage (i.e. SUMMARY) the
+  complete vector is loaded in one operation, otherwise the node is
+  loaded once for each report step.
+*/
+
+static void csv_table_load_column( csv_table_type * table , int column , enkf_node_type * node , enkf_fs_type * fs , const char * key_index , int iens , double_vector_type * vector) {
+  int step;
+
+  if (enkf_node_vector_storage( node )) {
+    double_vector_reset( vector );
+    if (enkf_node_user_get_vector( node , fs , key_index , iens , vector )) {
+      int num_steps = util_int_min( table->num_steps , double_vector_size( vector ));
+      for (step = 0; step < num_steps; step++)
+        csv_table_iset( table , step , column , double_vector_iget( vector , step ));
+    }
+  } else {
+    for (step = 0; step < table->num_steps; step++) {
+      node_id_type node_id = {.report_step = step , .iens = iens };
+      double value;
+      if (enkf_node_user_get( node , fs , key_index , node_id ,  &value))
+        csv_table_iset( table , step , column , value );
+    }
+  }
+}
+
+
+static void csv_table_fprintf( const csv_table_type * table , FILE * stream ) {
+  int step , column;
+  for (step = 0; step < table->num_steps; step++) {
+    fprintf(stream , "%6d" , step);
+    for (column = 0; column < table->num_columns; column++) {
+      int index = step * table->num_columns + column;
+      if (table->valid[index])
+        fprintf(stream , "%s%g" , CSV_SEP , table->data[index]);
+      else
+        fprintf(stream , "%s%s" , CSV_SEP , CSV_MISSING_VALUE);
+    }
+    fprintf(stream , CSV_NEWLINE);
+  }
+}
+
 
 
 void enkf_tui_export_scalar2csv(void * arg) {
   enkf_main_type * enkf_main = enkf_main_safe_cast( arg );
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
-  const enkf_config_node_type * config_node;
-  char * user_key, *key_index;
+  stringlist_type * user_keys = stringlist_alloc_new();
+  char ** key_index;
+  const enkf_config_node_type ** config_nodes;
+  int num_keys;
+  char * input_keys;
   
-  util_printf_prompt("Scalar to export (KEY:INDEX)" , PROMPT_LEN , '=' , "=> "); user_key = util_alloc_stdin_line();
-  config_node = ensemble_config_user_get_node( ensemble_config , user_key , &key_index);
-  if (config_node != NULL) {
-    int    report_step , first_report, last_report;
+  util_printf_prompt("Scalars to export (KEY1:INDEX1 KEY2:INDEX2 ...)" , PROMPT_LEN , '=' , "=> "); input_keys = util_alloc_stdin_line();
+  if (input_keys == NULL) {
+    stringlist_free( user_keys );
+    return;
+  }
+
+  {
+    int num_input , i;
+    char ** input_list;
+    util_split_string( input_keys , " " , &num_input , &input_list );
+    for (i = 0; i < num_input; i++) {
+      char * index = NULL;
+      if (ensemble_config_user_get_node( ensemble_config , input_list[i] , &index ) != NULL)
+        stringlist_append_copy( user_keys , input_list[i] );
+      else
+        fprintf(stderr,"Sorry - could not find any nodes with key:%s\n",input_list[i]);
+      util_safe_free( index );
+    }
+    util_free_stringlist( input_list , num_input );
+  }
+
+  num_keys     = stringlist_get_size( user_keys );
+  key_index    = util_calloc( num_keys , sizeof * key_index );
+  config_nodes = util_calloc( num_keys , sizeof * config_nodes );
+  {
+    int ikey;
+    for (ikey = 0; ikey < num_keys; ikey++)
+      config_nodes[ikey] = ensemble_config_user_get_node( ensemble_config , stringlist_iget( user_keys , ikey ) , &key_index[ikey]);
+  }
+
+  if (num_keys > 0) {
+    int    first_report, last_report;
     int    iens1 , iens2, iens;
     char * csv_file;
     
@@ -506,9 +1082,10 @@ void enkf_tui_export_scalar2csv(void * arg) {
     last_report  = enkf_main_get_history_length( enkf_main );
     {
       char * path;
-      char * prompt = util_alloc_sprintf("File to store \'%s\'", user_key);
+      char * prompt = util_alloc_sprintf("File to store \'%s\'", input_keys);
       util_printf_prompt(prompt , PROMPT_LEN , '=' , "=> ");
       csv_file = util_alloc_stdin_line();
+      free(prompt);
 
       util_alloc_file_components( csv_file , &path , NULL , NULL);
       if (path != NULL) {
@@ -518,8 +1095,7 @@ void enkf_tui_export_scalar2csv(void * arg) {
             fprintf(stderr,"Sorry: %s already exists - and is not a directory.\n",path);
             free(path);
             free(csv_file);
-            free(user_key);
-            return ;
+            csv_file = NULL;
           }
         } else {
           /* The path does not exist - we make it. */
@@ -527,61 +1103,69 @@ void enkf_tui_export_scalar2csv(void * arg) {
           util_make_path( path );
         }
       }
-      free(prompt);
+      util_safe_free( path );
     }
-    {
-      /* Seriously manual creation of csv file. */
-      enkf_fs_type * fs     = enkf_main_tui_get_fs(enkf_main);
-      enkf_node_type * node = enkf_node_alloc( config_node );
-      FILE * stream         = util_fopen( csv_file , "w");
-      msg_type * msg        = msg_alloc("Exporting report_step/member: " , false);
-      node_id_type node_id;
-      
 
-      /* Header line */
-      fprintf(stream , "\"Report step\"");
-      for (iens = iens1; iens <= iens2; iens++) 
-        fprintf(stream , "%s\"%s(%d)\"" , CSV_SEP , user_key , iens);
-      fprintf(stream , CSV_NEWLINE);
+    if (csv_file != NULL) {
+      const int ens_size     = iens2 - iens1 + 1;
+      enkf_fs_type * fs      = enkf_main_tui_get_fs(enkf_main);
+      csv_table_type * table = csv_table_alloc( last_report - first_report + 1 , num_keys * ens_size );
+      msg_type * msg         = msg_alloc("Loading key/member: " , false);
+      double_vector_type * vector = double_vector_alloc( 0 , 0 );
+      int ikey;
 
       msg_show(msg);
-      for (report_step = first_report; report_step <= last_report; report_step++) {
-        fprintf(stream , "%6d" , report_step);
-        node_id.report_step = report_step;
+      for (ikey = 0; ikey < num_keys; ikey++) {
+        enkf_node_type * node = enkf_node_alloc( config_nodes[ikey] );
         for (iens = iens1; iens <= iens2; iens++) {
-          double value;
-          char label[32];
-          /* 
-             Have not implemented a choice on forecast/analyzed. Tries
-             analyzed first, then forecast.
-          */
-          node_id.iens = iens;
-          sprintf(label , "%03d/%03d" , report_step , iens);
+          char * label = util_alloc_sprintf("%s/%03d" , stringlist_iget( user_keys , ikey ) , iens);
           msg_update( msg , label);
-          
-          if (enkf_node_user_get( node , fs , key_index , node_id ,  &value)) 
-            fprintf(stream , "%s%g" , CSV_SEP , value);
-          else
-            fprintf(stream , "%s%s" , CSV_SEP , CSV_MISSING_VALUE);
-          
+          free( label );
+
+          csv_table_load_column( table , ikey * ens_size + iens - iens1 , node , fs , key_index[ikey] , iens , vector);
         }
-        fprintf(stream , CSV_NEWLINE);
+        enkf_node_free( node );
       }
-
       msg_free( msg , true );
-      enkf_node_free( node );
-      fclose(stream);
+      double_vector_free( vector );
+
+      {
+        FILE * stream = util_fopen( csv_file , "w");
+        char * stream_buffer = util_malloc( CSV_BUFFER_SIZE );
+        setvbuf( stream , stream_buffer , _IOFBF , CSV_BUFFER_SIZE );
+        
+        /* Header line */
+        fprintf(stream , "\"Report step\"");
+        for (ikey = 0; ikey < num_keys; ikey++)
+          for (iens = iens1; iens <= iens2; iens++) 
+            fprintf(stream , "%s\"%s(%d)\"" , CSV_SEP , stringlist_iget( user_keys , ikey ) , iens);
+        fprintf(stream , CSV_NEWLINE);
+        
+        csv_table_fprintf( table , stream );
+        fclose(stream);
+        free( stream_buffer );
+      }
+      csv_table_free( table );
+      free( csv_file );
     }
-  } else 
-    fprintf(stderr,"Sorry - could not find any nodes with key:%s\n",user_key);
+  }
   
-  free(user_key);
+  {
+    int ikey;
+    for (ikey = 0; ikey < num_keys; ikey++)
+      util_safe_free( key_index[ikey] );
+  }
+  free( key_index );
+  free( config_nodes );
+  stringlist_free( user_keys );
+  free( input_keys );
 }
 
 
 #undef CSV_NEWLINE        
 #undef CSV_MISSING_VALUE  
 #undef CSV_SEP
+#undef CSV_BUFFER_SIZE
 
 /*****************************************************************/
 
@@ -598,8 +1182,10 @@ void enkf_tui_export_menu(void * arg) {
   menu_add_item(menu , "Export fields to ECLIPSE grdecl format"                 , "gG" , enkf_tui_export_grdecl                , enkf_main , NULL);
   menu_add_item(menu , "Export fields to ECLIPSE restart format (active cells)" , "aA" , enkf_tui_export_restart_active , enkf_main , NULL);
   menu_add_item(menu , "Export fields to ECLIPSE restart format (all cells)"    , "lL" , enkf_tui_export_restart_all    , enkf_main , NULL);
+  menu_add_item(menu , "Export several fields to several formats in one pass"   , "mM" , enkf_tui_export_fields_multi   , enkf_main , NULL);
   menu_add_separator(menu);
   menu_add_item(menu , "Export P( a =< x < b )"                                 , "sS" , enkf_tui_export_fieldP , enkf_main , NULL);                 
+  menu_add_item(menu , "Export ensemble statistics fields"                      , "eE" , enkf_tui_export_field_stat , enkf_main , NULL);
   menu_add_separator(menu);
   menu_add_item(menu , "Export cell values to text file(s)"                     , "cC" , enkf_tui_export_cell    , enkf_main , NULL);
   menu_add_item(menu , "Export line profile of a field to text file(s)"         , "pP" , enkf_tui_export_profile , enkf_main , NULL);
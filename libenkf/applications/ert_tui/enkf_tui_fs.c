@@ -23,6 +23,9 @@
 #include <ert/util/arg_pack.h>
 #include <ert/util/util.h>
 #include <ert/util/msg.h>
+#include <ert/util/buffer.h>
+#include <ert/util/thread_pool.h>
+#include <ert/util/stringlist.h>
 
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_types.h>
@@ -32,6 +35,8 @@
 #include <enkf_tui_help.h>
 #include <enkf_tui_init.h>
 #include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
+#include <enkf_tui_ranking.h>
 
 
 void enkf_tui_fs_ls_case(void * arg) {
@@ -64,8 +69,10 @@ void enkf_tui_fs_create_case(void * arg)
     if (newline)
       *newline = 0;
 
-    if(strlen(new_case) != 0)
+    if(strlen(new_case) != 0) {
       enkf_main_select_fs( enkf_main , new_case );
+      enkf_tui_ranking_invalidate_snapshots( );
+    }
 
   }
   menu_title = util_alloc_sprintf("Manage cases. Current: %s", enkf_main_get_current_fs(enkf_main));
@@ -119,6 +126,7 @@ void enkf_tui_fs_select_case(void * arg)
   new_case = enkf_tui_fs_alloc_existing_case( enkf_main , "Name of case" , prompt_len);
   if (new_case != NULL) {
     enkf_main_select_fs( enkf_main ,  new_case );
+    enkf_tui_ranking_invalidate_snapshots( );
 
     menu_title = util_alloc_sprintf("Manage cases. Current: %s", enkf_main_get_current_fs( enkf_main ));
     menu_set_title(menu, menu_title);
@@ -132,6 +140,95 @@ void enkf_tui_fs_select_case(void * arg)
 
 
 
+/**
+   Fast copy of parameters between two cases, used when the ensemble
+   is not permuted. The stored blobs are copied byte for byte with
+   enkf_fs_fread_node() / enkf_fs_fwrite_node() without decoding them
+   to enkf_node instances. The (key, realization) pairs are spread
+   over a pool of worker threads, each with its own buffer; the
+   target case is synced to disk once when all the copying is done.
+*/
+
+static void * enkf_tui_fs_copy_blobs_mt( void * arg ) {
+  arg_pack_type * arg_pack          = arg_pack_safe_cast( arg );
+  const ensemble_config_type * config = arg_pack_iget_const_ptr( arg_pack , 0 );
+  const stringlist_type * nodes     = arg_pack_iget_const_ptr( arg_pack , 1 );
+  enkf_fs_type * src_fs             = arg_pack_iget_ptr( arg_pack , 2 );
+  enkf_fs_type * target_fs          = arg_pack_iget_ptr( arg_pack , 3 );
+  enkf_tui_progress_type * progress = arg_pack_iget_ptr( arg_pack , 4 );
+  int report_step_from              = arg_pack_iget_int( arg_pack , 5 );
+  int report_step_to                = arg_pack_iget_int( arg_pack , 6 );
+  int ens_size                      = arg_pack_iget_int( arg_pack , 7 );
+  int job_offset                    = arg_pack_iget_int( arg_pack , 8 );
+  int job_step                      = arg_pack_iget_int( arg_pack , 9 );
+  int num_jobs                      = stringlist_get_size( nodes ) * ens_size;
+  buffer_type * buffer              = buffer_alloc( 1024 );
+  int job;
+
+  for (job = job_offset; job < num_jobs; job += job_step) {
+    const char * key = stringlist_iget( nodes , job / ens_size );
+    int iens         = job % ens_size;
+    enkf_var_type var_type = enkf_config_node_get_var_type( ensemble_config_get_node( config , key ));
+    size_t bytes = 0;
+    enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "copy_blob" , key , iens );
+
+    if (enkf_fs_has_node( src_fs , key , var_type , report_step_from , iens )) {
+      buffer_clear( buffer );
+      enkf_fs_fread_node( src_fs , buffer , key , var_type , report_step_from , iens );
+      enkf_fs_fwrite_node( target_fs , buffer , key , var_type , report_step_to , iens );
+      bytes = buffer_get_size( buffer );
+    }
+    enkf_tui_trace_span_add_bytes( span , bytes , bytes );
+    enkf_tui_trace_span_end( span );
+
+    if (iens == (ens_size - 1))
+      enkf_tui_progress_update( progress , 1 , bytes );
+    else if (bytes > 0)
+      enkf_tui_progress_update( progress , 0 , bytes );
+  }
+
+  buffer_free( buffer );
+  return NULL;
+}
+
+
+static void enkf_tui_fs_copy_blobs( const ensemble_config_type * config , const stringlist_type * nodes , enkf_fs_type * src_fs , enkf_fs_type * target_fs , int report_step_from , int report_step_to , int ens_size) {
+  int num_jobs                      = stringlist_get_size( nodes ) * ens_size;
+  int num_threads                   = util_int_max( 1 , util_int_min( enkf_tui_util_get_num_threads( ) , num_jobs ));
+  thread_pool_type * tp             = thread_pool_alloc( num_threads , true );
+  arg_pack_type ** arg_list         = util_calloc( num_threads , sizeof * arg_list );
+  enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Copying keys: " , stringlist_get_size( nodes ));
+  enkf_tui_trace_span_type * span   = enkf_tui_trace_span_begin( "copy_ensemble" , NULL , -1 );
+  int ithread;
+
+  for (ithread = 0; ithread < num_threads; ithread++) {
+    arg_list[ithread] = arg_pack_alloc( );
+    arg_pack_append_const_ptr( arg_list[ithread] , config );
+    arg_pack_append_const_ptr( arg_list[ithread] , nodes );
+    arg_pack_append_ptr( arg_list[ithread] , src_fs );
+    arg_pack_append_ptr( arg_list[ithread] , target_fs );
+    arg_pack_append_ptr( arg_list[ithread] , progress );
+    arg_pack_append_int( arg_list[ithread] , report_step_from );
+    arg_pack_append_int( arg_list[ithread] , report_step_to );
+    arg_pack_append_int( arg_list[ithread] , ens_size );
+    arg_pack_append_int( arg_list[ithread] , ithread );
+    arg_pack_append_int( arg_list[ithread] , num_threads );
+
+    thread_pool_add_job( tp , enkf_tui_fs_copy_blobs_mt , arg_list[ithread] );
+  }
+  thread_pool_join( tp );
+  enkf_fs_fsync( target_fs );
+  enkf_tui_trace_span_end( span );
+  enkf_tui_progress_free( progress );
+
+  for (ithread = 0; ithread < num_threads; ithread++)
+    arg_pack_free( arg_list[ithread] );
+  free( arg_list );
+  thread_pool_free( tp );
+}
+
+
+
 static void enkf_tui_fs_copy_ensemble__(
   enkf_main_type * enkf_main,
   const char     * source_case,
@@ -140,12 +237,10 @@ static void enkf_tui_fs_copy_ensemble__(
   int              report_step_to,
   bool             only_parameters)
 {
-  msg_type       * msg          = msg_alloc("Copying: " , false);
   ensemble_config_type * config = enkf_main_get_ensemble_config(enkf_main);
   int ens_size                  = enkf_main_get_ensemble_size(enkf_main);
   char * ranking_key;
   const perm_vector_type  * ranking_permutation = NULL;
-  int  * identity_permutation_raw;
   ranking_table_type * ranking_table = enkf_main_get_ranking_table( enkf_main );
 
 
@@ -159,17 +254,6 @@ static void enkf_tui_fs_copy_ensemble__(
       return;
     }
   }
-  identity_permutation_raw = util_calloc( ens_size , sizeof * identity_permutation_raw );
-  {
-    int iens;
-    for (iens =0; iens < ens_size; iens++)
-      identity_permutation_raw[iens] = iens;
-  }
-
-  if (ranking_permutation == NULL)
-    ranking_permutation = perm_vector_alloc(identity_permutation_raw, ens_size);
-
-
   {
     /* If the current target_case does not exist it is automatically created by the select_write_dir function */
     enkf_fs_type * src_fs    = enkf_main_mount_alt_fs( enkf_main , source_case , false );
@@ -177,8 +261,11 @@ static void enkf_tui_fs_copy_ensemble__(
 
     stringlist_type * nodes = ensemble_config_alloc_keylist_from_var_type(config, PARAMETER);
 
-    {
-      int num_nodes = stringlist_get_size(nodes);
+    if (ranking_permutation == NULL)
+      enkf_tui_fs_copy_blobs( config , nodes , src_fs , target_fs , report_step_from , report_step_to , ens_size );
+    else {
+      msg_type * msg = msg_alloc("Copying: " , false);
+      int num_nodes  = stringlist_get_size(nodes);
       msg_show(msg);
       for(int i = 0; i < num_nodes; i++) {
         const char * key = stringlist_iget(nodes, i);
@@ -186,15 +273,14 @@ static void enkf_tui_fs_copy_ensemble__(
         msg_update(msg , key);
         enkf_node_copy_ensemble(config_node, src_fs , target_fs , report_step_from, report_step_to , ens_size , ranking_permutation);
       }
+      msg_free(msg , true);
     }
 
     enkf_fs_decref( src_fs );
     enkf_fs_decref( target_fs );
 
-    msg_free(msg , true);
     stringlist_free(nodes);
   }
-  free( identity_permutation_raw );
 }
 
 
@@ -25,6 +25,9 @@
 #include <ert/util/util.h>
 #include <ert/util/menu.h>
 #include <ert/util/msg.h>
+#include <ert/util/arg_pack.h>
+#include <ert/util/thread_pool.h>
+#include <ert/util/stringlist.h>
 
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_types.h>
@@ -39,6 +42,68 @@
 
 
 
+/**
+   Initializes the parameters in param_list for the realizations in
+   iens_mask. The realizations are distributed over a thread pool;
+   all the parameters of one realization are initialized, in the
+   order of param_list, by the same enkf_state_initialize() call.
+   The sampling uses the rng of the enkf_state instance, i.e. every
+   realization has its own deterministic random stream, and the
+   result is independent of the number of threads.
+*/
+
+static void * enkf_tui_init_mt( void * arg ) {
+  arg_pack_type * arg_pack           = arg_pack_safe_cast( arg );
+  enkf_main_type * enkf_main         = arg_pack_iget_ptr( arg_pack , 0 );
+  enkf_fs_type * init_fs             = arg_pack_iget_ptr( arg_pack , 1 );
+  const stringlist_type * param_list = arg_pack_iget_const_ptr( arg_pack , 2 );
+  const bool_vector_type * iens_mask = arg_pack_iget_const_ptr( arg_pack , 3 );
+  enkf_tui_progress_type * progress  = arg_pack_iget_ptr( arg_pack , 4 );
+  init_mode_type init_mode           = arg_pack_iget_int( arg_pack , 5 );
+  int job_offset                     = arg_pack_iget_int( arg_pack , 6 );
+  int job_step                       = arg_pack_iget_int( arg_pack , 7 );
+
+  for (int iens = job_offset; iens < bool_vector_size( iens_mask ); iens += job_step) {
+    if (bool_vector_iget( iens_mask , iens )) {
+      enkf_state_initialize( enkf_main_iget_state( enkf_main , iens ) , init_fs , param_list , init_mode );
+      enkf_tui_progress_update( progress , 1 , 0 );
+    }
+  }
+  return NULL;
+}
+
+
+static void enkf_tui_init_parallel( enkf_main_type * enkf_main , enkf_fs_type * init_fs , const stringlist_type * param_list , const bool_vector_type * iens_mask , init_mode_type init_mode ) {
+  int num_active  = bool_vector_count_equal( iens_mask , true );
+  int num_threads = util_int_min( enkf_tui_util_get_num_threads() , util_int_max( 1 , num_active ));
+  enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Initializing: " , num_active );
+  thread_pool_type * tp = thread_pool_alloc( num_threads , true );
+  arg_pack_type ** arg_list = util_calloc( num_threads , sizeof * arg_list );
+
+  for (int ithread = 0; ithread < num_threads; ithread++) {
+    arg_list[ithread] = arg_pack_alloc( );
+    arg_pack_append_ptr( arg_list[ithread] , enkf_main );
+    arg_pack_append_ptr( arg_list[ithread] , init_fs );
+    arg_pack_append_const_ptr( arg_list[ithread] , param_list );
+    arg_pack_append_const_ptr( arg_list[ithread] , iens_mask );
+    arg_pack_append_ptr( arg_list[ithread] , progress );
+    arg_pack_append_int( arg_list[ithread] , init_mode );
+    arg_pack_append_int( arg_list[ithread] , ithread );
+    arg_pack_append_int( arg_list[ithread] , num_threads );
+
+    thread_pool_add_job( tp , enkf_tui_init_mt , arg_list[ithread] );
+  }
+  thread_pool_join( tp );
+  enkf_fs_fsync( init_fs );
+
+  for (int ithread = 0; ithread < num_threads; ithread++)
+    arg_pack_free( arg_list[ithread] );
+  free( arg_list );
+  thread_pool_free( tp );
+  enkf_tui_progress_free( progress );
+}
+
+
 void enkf_tui_init(enkf_main_type * enkf_main, bool all_members , bool all_parameters , bool interval ) {
   const int prompt_len                         = 35;
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
@@ -92,7 +157,7 @@ void enkf_tui_init(enkf_main_type * enkf_main, bool all_members , bool all_param
       enkf_fs_type * init_fs = enkf_main_tui_get_fs( enkf_main );
       bool_vector_type * iens_mask = bool_vector_alloc( ens_size , false );
       bool_vector_iset_block( iens_mask , iens1 , iens2 - iens1 + 1, true );
-      enkf_main_initialize_from_scratch(enkf_main , init_fs , param_list , iens_mask , init_mode);
+      enkf_tui_init_parallel( enkf_main , init_fs , param_list , iens_mask , init_mode );
       bool_vector_free( iens_mask );
       stringlist_free( param_list );
     }
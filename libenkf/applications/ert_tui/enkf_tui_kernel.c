@@ -0,0 +1,257 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_kernel.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <ert/util/util.h>
+
+#include <ert/enkf/enkf_types.h>
+#include <ert/enkf/field.h>
+#include <ert/enkf/field_config.h>
+#include <ert/enkf/field_trans.h>
+
+#include <enkf_tui_kernel.h>
+
+/**
+   Per cell kernels for the field exports and statistics. The field
+   functions in libenkf go through a function pointer, and a switch on
+   the data type, for every cell; these kernels work on plain double
+   arrays, with the choice of operation made once outside the loop,
+   so the compiler can vectorize them.
+
+   With gcc on x86_64 the kernels are compiled both for AVX2 and for
+   the baseline instruction set (SSE2), and the best version is picked
+   at runtime; with other compilers the plain loops are used.
+
+   The compiler can not vectorize a loop which calls the scalar exp(),
+   log() or pow() of libm. When the build finds the glibc vector math
+   library (libmvec), ENKF_TUI_KERNEL_MVEC is defined and the file is
+   compiled with -fopenmp-simd; exp() and log() are then declared as
+   simd functions, and the transform loops call the libmvec versions,
+   which are accurate to within 4 ulp instead of 1 ulp. POW10 is
+   computed as exp(x*ln(10)) and LOG10 as log(x)/ln(10) on this path.
+   Without libmvec only the truncation, the indicator and the
+   arithmetic kernels are vectorized; enkf_tui_kernel_bench measures
+   the difference.
+*/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && (__GNUC__ >= 6)
+#define KERNEL_CLONES __attribute__((target_clones("avx2","default")))
+#else
+#define KERNEL_CLONES
+#endif
+
+#ifdef ENKF_TUI_KERNEL_MVEC
+#pragma omp declare simd notinbranch
+double exp( double );
+#pragma omp declare simd notinbranch
+double log( double );
+
+#define KERNEL_SIMD      _Pragma("omp simd")
+#define KERNEL_POW10(x)  exp( (x) * M_LN10 )
+#define KERNEL_LOG10(x)  (log( x ) * (1.0 / M_LN10))
+#else
+#define KERNEL_SIMD
+#define KERNEL_POW10(x)  pow( 10.0 , (x) )
+#define KERNEL_LOG10(x)  log10( x )
+#endif
+
+
+typedef enum {
+  TRANSFORM_NONE,
+  TRANSFORM_POW10,
+  TRANSFORM_TRUNC_POW10,
+  TRANSFORM_LN,
+  TRANSFORM_LOG10,
+  TRANSFORM_EXP,
+  TRANSFORM_LN0,
+  TRANSFORM_EXP0,
+  TRANSFORM_LIBRARY
+} transform_type;
+
+
+/*
+  The transforms from field_trans.c which have a vectorized kernel
+  here; any other output transform, e.g. one which has been added to
+  libenkf later, is applied through the function pointer of the field
+  configuration (TRANSFORM_LIBRARY).
+*/
+
+static transform_type enkf_tui_kernel_get_transform( const char * name ) {
+  if (name == NULL)
+    return TRANSFORM_NONE;
+  else if (util_string_equal( name , "POW10" ))
+    return TRANSFORM_POW10;
+  else if (util_string_equal( name , "TRUNC_POW10" ))
+    return TRANSFORM_TRUNC_POW10;
+  else if (util_string_equal( name , "LN" ) || util_string_equal( name , "LOG" ))
+    return TRANSFORM_LN;
+  else if (util_string_equal( name , "LOG10" ))
+    return TRANSFORM_LOG10;
+  else if (util_string_equal( name , "EXP" ))
+    return TRANSFORM_EXP;
+  else if (util_string_equal( name , "LN0" ))
+    return TRANSFORM_LN0;
+  else if (util_string_equal( name , "EXP0" ))
+    return TRANSFORM_EXP0;
+  else
+    return TRANSFORM_LIBRARY;
+}
+
+
+void enkf_tui_kernel_load_field( const field_type * field , int data_size , double * values ) {
+  for (int i = 0; i < data_size; i++)
+    values[i] = field_iget_double( field , i );
+}
+
+
+KERNEL_CLONES
+static void enkf_tui_kernel_truncate( int data_size , double * values , int truncation , double min_value , double max_value) {
+  if (truncation & TRUNCATE_MIN) {
+    for (int i = 0; i < data_size; i++)
+      values[i] = (values[i] < min_value) ? min_value : values[i];
+  }
+
+  if (truncation & TRUNCATE_MAX) {
+    for (int i = 0; i < data_size; i++)
+      values[i] = (values[i] > max_value) ? max_value : values[i];
+  }
+}
+
+
+/*
+  Applies one of the vectorized transforms; returns false, and leaves
+  values untouched, for TRANSFORM_LIBRARY.
+*/
+
+KERNEL_CLONES
+static bool enkf_tui_kernel_transform( transform_type transform , int data_size , double * values ) {
+  int i;
+
+  switch (transform) {
+  case TRANSFORM_NONE:
+    break;
+  case TRANSFORM_POW10:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = KERNEL_POW10( values[i] );
+    break;
+  case TRANSFORM_TRUNC_POW10:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++) {
+      double x = KERNEL_POW10( values[i] );
+      values[i] = (x < 0.001) ? 0.001 : x;
+    }
+    break;
+  case TRANSFORM_LN:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = log( values[i] );
+    break;
+  case TRANSFORM_LOG10:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = KERNEL_LOG10( values[i] );
+    break;
+  case TRANSFORM_EXP:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = exp( values[i] );
+    break;
+  case TRANSFORM_LN0:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = log( values[i] + 0.000001 );
+    break;
+  case TRANSFORM_EXP0:
+    KERNEL_SIMD
+    for (i = 0; i < data_size; i++)
+      values[i] = exp( values[i] ) - 0.000001;
+    break;
+  case TRANSFORM_LIBRARY:
+    return false;
+  }
+  return true;
+}
+
+
+/**
+   Applies the output transform with the name transform_name, as used
+   in the field configuration, to values. Returns false if there is no
+   vectorized kernel for the transform, and values are left untouched.
+*/
+
+bool enkf_tui_kernel_apply_transform( const char * transform_name , int data_size , double * values ) {
+  return enkf_tui_kernel_transform( enkf_tui_kernel_get_transform( transform_name ) , data_size , values );
+}
+
+
+/**
+   Applies the output transform, and then the truncation, of the
+   field configuration to values; this should give the same values as
+   field_export() with output_transform == true, to within the accuracy
+   of the vector math library described above.
+*/
+
+void enkf_tui_kernel_output_transform( const field_config_type * config , int data_size , double * values ) {
+  if (!enkf_tui_kernel_apply_transform( field_config_get_output_transform_name( config ) , data_size , values )) {
+    field_func_type * func = field_config_get_output_transform( config );
+    if (func != NULL) {
+      for (int i = 0; i < data_size; i++)
+        values[i] = func( values[i] );
+    }
+  }
+
+  enkf_tui_kernel_truncate( data_size ,
+                            values ,
+                            field_config_get_truncation_mode( config ) ,
+                            field_config_get_truncation_min( config ) ,
+                            field_config_get_truncation_max( config ));
+}
+
+
+/**
+   Adds one to sum[i] for every cell with lower_limit <= values[i] <
+   upper_limit; the comparison is evaluated without branches.
+*/
+
+KERNEL_CLONES
+void enkf_tui_kernel_indicator_sum( int data_size , const double * values , double lower_limit , double upper_limit , double * sum ) {
+  for (int i = 0; i < data_size; i++)
+    sum[i] += (double) ((values[i] >= lower_limit) & (values[i] < upper_limit));
+}
+
+
+KERNEL_CLONES
+void enkf_tui_kernel_iadd( int data_size , double * sum , const double * values ) {
+  for (int i = 0; i < data_size; i++)
+    sum[i] += values[i];
+}
+
+
+KERNEL_CLONES
+void enkf_tui_kernel_scale( int data_size , double * values , double factor ) {
+  for (int i = 0; i < data_size; i++)
+    values[i] *= factor;
+}
+
+#undef KERNEL_CLONES
+#undef KERNEL_SIMD
+#undef KERNEL_POW10
+#undef KERNEL_LOG10
@@ -0,0 +1,34 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_kernel.h' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#ifndef ERT_ENKF_TUI_KERNEL_H
+#define ERT_ENKF_TUI_KERNEL_H
+
+#include <stdbool.h>
+
+#include <ert/enkf/field.h>
+#include <ert/enkf/field_config.h>
+
+void enkf_tui_kernel_load_field( const field_type * field , int data_size , double * values );
+bool enkf_tui_kernel_apply_transform( const char * transform_name , int data_size , double * values );
+void enkf_tui_kernel_output_transform( const field_config_type * config , int data_size , double * values );
+void enkf_tui_kernel_indicator_sum( int data_size , const double * values , double lower_limit , double upper_limit , double * sum );
+void enkf_tui_kernel_iadd( int data_size , double * sum , const double * values );
+void enkf_tui_kernel_scale( int data_size , double * values , double factor );
+
+#endif
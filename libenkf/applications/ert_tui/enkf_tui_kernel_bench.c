@@ -0,0 +1,157 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_kernel_bench.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <ert/util/util.h>
+
+#include <enkf_tui_kernel.h>
+
+/**
+   Small benchmark for the output transform kernels in
+   enkf_tui_kernel.c: every transform is timed against a plain loop
+   over the scalar libm function, and the largest relative deviation
+   from the scalar result is reported. The time is the best of
+   num_repeat runs over num_cells values:
+
+      enkf_tui_kernel_bench [num_cells] [num_repeat]
+*/
+
+typedef struct {
+  const char * name;
+  double       min_value;
+  double       max_value;
+  double    (* func)( double );
+} bench_transform_type;
+
+
+static double bench_pow10( double x ) {
+  return pow( 10.0 , x );
+}
+
+
+static double bench_ln0( double x ) {
+  return log( x + 0.000001 );
+}
+
+
+static double bench_exp0( double x ) {
+  return exp( x ) - 0.000001;
+}
+
+
+static const bench_transform_type transforms[] = {{"POW10" , -3.0  , 3.0    , bench_pow10},
+                                                  {"LN"    , 0.001 , 1000.0 , log},
+                                                  {"LOG10" , 0.001 , 1000.0 , log10},
+                                                  {"EXP"   , -5.0  , 5.0    , exp},
+                                                  {"LN0"   , 0.001 , 1000.0 , bench_ln0},
+                                                  {"EXP0"  , -5.0  , 5.0    , bench_exp0}};
+
+
+static double bench_wallclock( void ) {
+  struct timeval tv;
+  gettimeofday( &tv , NULL );
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+
+static void bench_scalar( const bench_transform_type * transform , int data_size , double * values ) {
+  for (int i = 0; i < data_size; i++)
+    values[i] = transform->func( values[i] );
+}
+
+
+static void bench_kernel( const bench_transform_type * transform , int data_size , double * values ) {
+  enkf_tui_kernel_apply_transform( transform->name , data_size , values );
+}
+
+
+static double bench_time( void (* run)( const bench_transform_type * , int , double * ) ,
+                          const bench_transform_type * transform ,
+                          int data_size ,
+                          int num_repeat ,
+                          const double * input ,
+                          double * values) {
+  double best = -1;
+  for (int irepeat = 0; irepeat < num_repeat; irepeat++) {
+    double t0;
+    memcpy( values , input , data_size * sizeof * values );
+    t0 = bench_wallclock( );
+    run( transform , data_size , values );
+    t0 = bench_wallclock( ) - t0;
+    if ((best < 0) || (t0 < best))
+      best = t0;
+  }
+  return best;
+}
+
+
+int main( int argc , char ** argv ) {
+  int data_size  = 1000000;
+  int num_repeat = 20;
+
+  if (argc > 1 && (!util_sscanf_int( argv[1] , &data_size ) || data_size <= 0))
+    util_exit("%s: invalid number of cells:%s \n" , argv[0] , argv[1]);
+
+  if (argc > 2 && (!util_sscanf_int( argv[2] , &num_repeat ) || num_repeat <= 0))
+    util_exit("%s: invalid number of repeats:%s \n" , argv[0] , argv[2]);
+
+  {
+    double * input  = util_calloc( data_size , sizeof * input );
+    double * scalar = util_calloc( data_size , sizeof * scalar );
+    double * kernel = util_calloc( data_size , sizeof * kernel );
+
+    printf("%d cells, best of %d runs \n\n" , data_size , num_repeat );
+    printf("%-9s %14s %14s %8s %14s \n" , "Transform" , "scalar ns/cell" , "kernel ns/cell" , "speedup" , "max rel. dev");
+    for (size_t it = 0; it < sizeof transforms / sizeof transforms[0]; it++) {
+      const bench_transform_type * transform = &transforms[it];
+      double scalar_time , kernel_time;
+      double max_dev = 0;
+
+      for (int i = 0; i < data_size; i++)
+        input[i] = transform->min_value + (transform->max_value - transform->min_value) * i / data_size;
+
+      scalar_time = bench_time( bench_scalar , transform , data_size , num_repeat , input , scalar );
+      kernel_time = bench_time( bench_kernel , transform , data_size , num_repeat , input , kernel );
+
+      for (int i = 0; i < data_size; i++) {
+        double dev = fabs( kernel[i] - scalar[i] );
+        if (scalar[i] != 0)
+          dev /= fabs( scalar[i] );
+        if (dev > max_dev)
+          max_dev = dev;
+      }
+
+      printf("%-9s %14.3f %14.3f %8.2f %14.3g \n" ,
+             transform->name ,
+             1e9 * scalar_time / data_size ,
+             1e9 * kernel_time / data_size ,
+             (kernel_time > 0) ? scalar_time / kernel_time : 0.0 ,
+             max_dev );
+    }
+
+    free( kernel );
+    free( scalar );
+    free( input );
+  }
+  exit(0);
+}
@@ -66,6 +66,7 @@ void enkf_tui_main_menu(void * arg) {
   menu_add_item(menu , "Simple menu"                           , "sS" , enkf_tui_simple_menu    , enkf_main , NULL);
   menu_run(menu);
   menu_free(menu);
+  enkf_tui_ranking_free_snapshots( );
 }
 
 
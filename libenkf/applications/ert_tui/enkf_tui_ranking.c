@@ -22,17 +22,232 @@
 #include <ert/util/menu.h>
 #include <ert/util/util.h>
 #include <ert/util/arg_pack.h>
+#include <ert/util/thread_pool.h>
+#include <ert/util/int_vector.h>
+#include <ert/util/bool_vector.h>
+#include <ert/util/stringlist.h>
 #include <ert/util/string_util.h>
+#include <ert/util/hash.h>
 
 #include <ert/enkf/enkf_fs.h>
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_obs.h>
 #include <ert/enkf/ranking_table.h>
 #include <ert/enkf/misfit_ensemble.h>
+#include <ert/enkf/misfit_member.h>
+#include <ert/enkf/obs_vector.h>
+#include <ert/enkf/state_map.h>
 
 #include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
 #include <enkf_tui_help.h>
 
+/**
+   The misfit table is updated incrementally: a snapshot of the
+   state_map of the case is taken when the table is built, and the next
+   time the table is updated only the realizations whose state has
+   changed since the snapshot are recomputed.
+
+   The misfit ensemble is owned by the enkf_fs instance in libres,
+   which has no room for the snapshot; the snapshots are therefor kept
+   here, one per case, for the lifetime of the tui. A case which is
+   remounted gets a new misfit ensemble, which need not match the
+   snapshot. The tui can not see the remount itself, so the snapshots
+   are stamped with a generation number: every tui operation which can
+   remount a case calls enkf_tui_ranking_invalidate_snapshots(), which
+   bumps the generation, and only a snapshot from the current
+   generation is used.
+*/
+
+typedef struct {
+  int               generation;
+  int_vector_type * states;
+} enkf_tui_misfit_snapshot_type;
+
+static hash_type * enkf_tui_misfit_snapshots = NULL;
+static int         enkf_tui_misfit_generation = 0;
+
+
+static void enkf_tui_misfit_snapshot_free__( void * arg ) {
+  enkf_tui_misfit_snapshot_type * snapshot = arg;
+  int_vector_free( snapshot->states );
+  free( snapshot );
+}
+
+
+void enkf_tui_ranking_invalidate_snapshots( void ) {
+  enkf_tui_misfit_generation++;
+}
+
+
+void enkf_tui_ranking_free_snapshots( void ) {
+  if (enkf_tui_misfit_snapshots != NULL) {
+    hash_free( enkf_tui_misfit_snapshots );
+    enkf_tui_misfit_snapshots = NULL;
+  }
+}
+
+
+/*
+  Returns NULL if there is no snapshot of the case from the current
+  generation.
+*/
+
+static const enkf_tui_misfit_snapshot_type * enkf_tui_misfit_snapshot_get( enkf_fs_type * fs ) {
+  const char * case_name = enkf_fs_get_case_name( fs );
+  if ((enkf_tui_misfit_snapshots != NULL) && hash_has_key( enkf_tui_misfit_snapshots , case_name )) {
+    const enkf_tui_misfit_snapshot_type * snapshot = hash_get( enkf_tui_misfit_snapshots , case_name );
+    if (snapshot->generation == enkf_tui_misfit_generation)
+      return snapshot;
+  }
+  return NULL;
+}
+
+
+static void enkf_tui_misfit_snapshot_update( enkf_fs_type * fs , int ens_size ) {
+  const char * case_name = enkf_fs_get_case_name( fs );
+  state_map_type * state_map = enkf_fs_get_state_map( fs );
+  enkf_tui_misfit_snapshot_type * snapshot;
+
+  if (enkf_tui_misfit_snapshots == NULL)
+    enkf_tui_misfit_snapshots = hash_alloc( );
+
+  if (hash_has_key( enkf_tui_misfit_snapshots , case_name ))
+    snapshot = hash_get( enkf_tui_misfit_snapshots , case_name );
+  else {
+    snapshot = util_malloc( sizeof * snapshot );
+    snapshot->states = int_vector_alloc( 0 , STATE_UNDEFINED );
+    hash_insert_hash_owned_ref( enkf_tui_misfit_snapshots , case_name , snapshot , enkf_tui_misfit_snapshot_free__ );
+  }
+
+  snapshot->generation = enkf_tui_misfit_generation;
+  int_vector_reset( snapshot->states );
+  for (int iens = 0; iens < ens_size; iens++)
+    int_vector_iset( snapshot->states , iens , state_map_iget( state_map , iens ));
+}
+
+
+/*
+  Returns the number of selected realizations.
+*/
+
+static int enkf_tui_misfit_snapshot_select_changed( const enkf_tui_misfit_snapshot_type * snapshot , enkf_fs_type * fs , int ens_size , bool_vector_type * changed ) {
+  state_map_type * state_map = enkf_fs_get_state_map( fs );
+  int num_changed = 0;
+  for (int iens = 0; iens < ens_size; iens++) {
+    bool iens_changed = (state_map_iget( state_map , iens ) != int_vector_safe_iget( snapshot->states , iens ));
+    bool_vector_iset( changed , iens , iens_changed );
+    if (iens_changed)
+      num_changed++;
+  }
+  return num_changed;
+}
+
+
+/*
+  The misfit of a realization can be replaced, but not removed from
+  the misfit ensemble. When a realization which had data in the
+  snapshot no longer has data its stale misfit must be dropped, and
+  that requires a full rebuild.
+*/
+
+static bool enkf_tui_misfit_snapshot_has_invalidated( const enkf_tui_misfit_snapshot_type * snapshot , enkf_fs_type * fs , int ens_size ) {
+  state_map_type * state_map = enkf_fs_get_state_map( fs );
+  for (int iens = 0; iens < ens_size; iens++) {
+    int old_state = int_vector_safe_iget( snapshot->states , iens );
+    if ((old_state == STATE_HAS_DATA) && (state_map_iget( state_map , iens ) != STATE_HAS_DATA))
+      return true;
+  }
+  return false;
+}
+
+
+/**
+   Each worker recomputes the misfit of a strided subset of the
+   changed realizations for all observation vectors. All the misfit
+   values of one realization are owned by one misfit_member instance,
+   i.e. the workers never update the same member.
+*/
+
+static void * enkf_tui_ranking_update_misfit_mt( void * arg ) {
+  arg_pack_type * arg_pack                = arg_pack_safe_cast( arg );
+  misfit_ensemble_type * misfit_ensemble  = arg_pack_iget_ptr( arg_pack , 0 );
+  enkf_obs_type * enkf_obs                = arg_pack_iget_ptr( arg_pack , 1 );
+  enkf_fs_type * fs                       = arg_pack_iget_ptr( arg_pack , 2 );
+  const stringlist_type * obs_keys        = arg_pack_iget_const_ptr( arg_pack , 3 );
+  const int_vector_type * changed_list    = arg_pack_iget_const_ptr( arg_pack , 4 );
+  enkf_tui_progress_type * progress       = arg_pack_iget_ptr( arg_pack , 5 );
+  int ens_size                            = arg_pack_iget_int( arg_pack , 6 );
+  int history_length                      = arg_pack_iget_int( arg_pack , 7 );
+  int job_offset                          = arg_pack_iget_int( arg_pack , 8 );
+  int job_step                            = arg_pack_iget_int( arg_pack , 9 );
+
+  bool_vector_type * valid = bool_vector_alloc( ens_size , false );
+  double ** chi2_work = util_calloc( history_length + 1 , sizeof * chi2_work );
+  for (int step = 0; step <= history_length; step++)
+    chi2_work[step] = util_calloc( ens_size , sizeof * chi2_work[step] );
+
+  for (int i = job_offset; i < int_vector_size( changed_list ); i += job_step) {
+    int iens = int_vector_iget( changed_list , i );
+    misfit_member_type * member = misfit_ensemble_iget_member( misfit_ensemble , iens );
+    enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "update_misfit" , NULL , iens );
+
+    for (int iobs = 0; iobs < stringlist_get_size( obs_keys ); iobs++) {
+      const char * obs_key = stringlist_iget( obs_keys , iobs );
+      obs_vector_type * obs_vector = enkf_obs_get_vector( enkf_obs , obs_key );
+
+      bool_vector_iset( valid , iens , true );
+      obs_vector_ensemble_chi2( obs_vector , fs , valid , 0 , history_length , iens , iens + 1 , chi2_work );
+      if (bool_vector_iget( valid , iens ))
+        misfit_member_update( member , obs_key , history_length , iens , (const double **) chi2_work );
+    }
+    enkf_tui_trace_span_end( span );
+    enkf_tui_progress_update( progress , 1 , 0 );
+  }
+
+  for (int step = 0; step <= history_length; step++)
+    free( chi2_work[step] );
+  free( chi2_work );
+  bool_vector_free( valid );
+  return NULL;
+}
+
+
+static void enkf_tui_ranking_update_misfit( misfit_ensemble_type * misfit_ensemble , enkf_obs_type * enkf_obs , enkf_fs_type * fs , const bool_vector_type * changed , int ens_size , int history_length ) {
+  int_vector_type * changed_list = bool_vector_alloc_active_list( changed );
+  stringlist_type * obs_keys     = enkf_obs_alloc_keylist( enkf_obs );
+  int num_threads = util_int_min( enkf_tui_util_get_num_threads() , util_int_max( 1 , int_vector_size( changed_list )));
+  enkf_tui_progress_type * progress = enkf_tui_progress_alloc( "Updating misfit table: " , int_vector_size( changed_list ));
+  thread_pool_type * tp = thread_pool_alloc( num_threads , true );
+  arg_pack_type ** arg_list = util_calloc( num_threads , sizeof * arg_list );
+
+  for (int ithread = 0; ithread < num_threads; ithread++) {
+    arg_list[ithread] = arg_pack_alloc( );
+    arg_pack_append_ptr( arg_list[ithread] , misfit_ensemble );
+    arg_pack_append_ptr( arg_list[ithread] , enkf_obs );
+    arg_pack_append_ptr( arg_list[ithread] , fs );
+    arg_pack_append_const_ptr( arg_list[ithread] , obs_keys );
+    arg_pack_append_const_ptr( arg_list[ithread] , changed_list );
+    arg_pack_append_ptr( arg_list[ithread] , progress );
+    arg_pack_append_int( arg_list[ithread] , ens_size );
+    arg_pack_append_int( arg_list[ithread] , history_length );
+    arg_pack_append_int( arg_list[ithread] , ithread );
+    arg_pack_append_int( arg_list[ithread] , num_threads );
+
+    thread_pool_add_job( tp , enkf_tui_ranking_update_misfit_mt , arg_list[ithread] );
+  }
+  thread_pool_join( tp );
+
+  for (int ithread = 0; ithread < num_threads; ithread++)
+    arg_pack_free( arg_list[ithread] );
+  free( arg_list );
+  thread_pool_free( tp );
+  enkf_tui_progress_free( progress );
+  stringlist_free( obs_keys );
+  int_vector_free( changed_list );
+}
+
+
 static void enkf_tui_ranking_make_misfit_ensemble( void * arg) {
   arg_pack_type * arg_pack                     = arg_pack_safe_cast( arg );
   enkf_main_type  * enkf_main                  = arg_pack_iget_ptr( arg_pack , 0 );
@@ -45,7 +260,26 @@ static void enkf_tui_ranking_make_misfit_ensemble( void * arg) {
   
     
   misfit_ensemble_type * misfit_ensemble = enkf_fs_get_misfit_ensemble( fs );
-  misfit_ensemble_initialize( misfit_ensemble , ensemble_config , enkf_obs , fs , ens_size , history_length , false);
+  const enkf_tui_misfit_snapshot_type * snapshot = enkf_tui_misfit_snapshot_get( fs );
+  if ((snapshot == NULL) || !misfit_ensemble_initialized( misfit_ensemble ))
+    /*
+      Without a snapshot the table is built as before, i.e. a table
+      which is already initialized is used as it is. The misfit
+      members are allocated, and the table is marked as initialized,
+      inside libres; so the first build of a case is serial.
+    */
+    misfit_ensemble_initialize( misfit_ensemble , ensemble_config , enkf_obs , fs , ens_size , history_length , false);
+  else if (enkf_tui_misfit_snapshot_has_invalidated( snapshot , fs , ens_size ))
+    misfit_ensemble_initialize( misfit_ensemble , ensemble_config , enkf_obs , fs , ens_size , history_length , true);
+  else {
+    bool_vector_type * changed = bool_vector_alloc( ens_size , false );
+    if (enkf_tui_misfit_snapshot_select_changed( snapshot , fs , ens_size , changed ) > 0)
+      enkf_tui_ranking_update_misfit( misfit_ensemble , enkf_obs , fs , changed , ens_size , history_length );
+    else
+      printf("Misfit table is up to date.\n");
+    bool_vector_free( changed );
+  }
+  enkf_tui_misfit_snapshot_update( fs , ens_size );
   {
     menu_item_type * obs_item                    = arg_pack_iget_ptr( arg_pack , 1 ); 
     menu_item_enable( obs_item );
@@ -22,6 +22,8 @@
 
 
 void    enkf_tui_ranking_menu(void * );
+void    enkf_tui_ranking_invalidate_snapshots( void );
+void    enkf_tui_ranking_free_snapshots( void );
 
 
 
@@ -21,22 +21,37 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <ert/util/util.h>
 #include <ert/util/menu.h>
 #include <ert/util/thread_pool.h>
 #include <ert/util/arg_pack.h>
 #include <ert/util/bool_vector.h>
+#include <ert/util/int_vector.h>
+#include <ert/util/stringlist.h>
 #include <ert/util/string_util.h>
 
+#include <ert/ecl/ecl_util.h>
+
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_fs.h>
 #include <ert/enkf/ensemble_config.h>
 #include <ert/enkf/enkf_analysis.h>
+#include <ert/enkf/enkf_types.h>
 #include <ert/enkf/ecl_config.h>
 #include <ert/enkf/run_arg.h>
+#include <ert/enkf/enkf_state.h>
+#include <ert/enkf/enkf_config_node.h>
+#include <ert/enkf/gen_data_config.h>
+#include <ert/enkf/ert_run_context.h>
+#include <ert/enkf/model_config.h>
 
 #include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
+#include <enkf_tui_ranking.h>
 #include <enkf_tui_fs.h>
 #include <enkf_tui_analysis.h>
 #include <ert_tui_const.h>
@@ -51,7 +66,10 @@ void enkf_tui_run_smoother(void * arg) {
   int ens_size = enkf_main_get_ensemble_size( enkf_main );
   bool_vector_type * iactive = bool_vector_alloc( ens_size , true );
   enkf_fs_type * source_fs = enkf_main_tui_get_fs( enkf_main );
+  enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "run_smoother" , "AUTO-SMOOTHER" , -1 );
   enkf_main_run_smoother(enkf_main , source_fs , "AUTO-SMOOTHER" , iactive , 0 , true );
+  enkf_tui_ranking_invalidate_snapshots( );
+  enkf_tui_trace_span_end( span );
   bool_vector_free( iactive );
 }
 
@@ -63,6 +81,7 @@ void enkf_tui_run_iterated_ES(void * arg) {
   analysis_iter_config_type * iter_config = analysis_config_get_iter_config(analysis_config);
   int num_iter = analysis_iter_config_get_num_iterations(iter_config);
   enkf_main_run_iterated_ES(enkf_main , num_iter );
+  enkf_tui_ranking_invalidate_snapshots( );
 }
 
 
@@ -126,6 +145,259 @@ static void enkf_tui_display_load_msg( int iens , const stringlist_type * msg_li
 }
 
 
+/**
+   The manual load is organized as a pipeline with three stages:
+
+     1. A pool of ENKF_TUI_LOAD_IO_THREADS I/O workers read the
+        summary and GEN_DATA result files of one realization each, so
+        that they are in the page cache. These workers are mainly
+        waiting on the (network) filesystem, hence there are more of
+        them than cpu's.
+
+     2. A pool of cpu bound workers load the realizations which have
+        been prefetched into enkf_fs with
+        enkf_state_load_from_forward_model().
+
+     3. The calling thread moves realizations from stage 1 to stage 2
+        and prints the status of every realization as soon as it has
+        been loaded.
+
+   The stages communicate through the enkf_tui_load_queue_type below.
+*/
+
+#define ENKF_TUI_LOAD_IO_THREADS       16
+#define ENKF_TUI_PREFETCH_BUFFER_SIZE  (1 << 20)
+
+typedef struct {
+  pthread_mutex_t   mutex;
+  pthread_cond_t    cond;
+  int_vector_type * prefetched;
+  int_vector_type * loaded;
+} enkf_tui_load_queue_type;
+
+
+static void enkf_tui_load_queue_push( enkf_tui_load_queue_type * queue , int_vector_type * stage , int iens ) {
+  pthread_mutex_lock( &queue->mutex );
+  int_vector_append( stage , iens );
+  pthread_cond_signal( &queue->cond );
+  pthread_mutex_unlock( &queue->mutex );
+}
+
+
+static size_t enkf_tui_run_prefetch_file( const char * filename , char * buffer ) {
+  size_t bytes = 0;
+  int fd = open( filename , O_RDONLY );
+  if (fd != -1) {
+    ssize_t read_size;
+    while ((read_size = read( fd , buffer , ENKF_TUI_PREFETCH_BUFFER_SIZE )) > 0)
+      bytes += read_size;
+    close( fd );
+  }
+  return bytes;
+}
+
+
+static void * enkf_tui_run_prefetch_mt( void * arg ) {
+  arg_pack_type * arg_pack               = arg_pack_safe_cast( arg );
+  enkf_tui_load_queue_type * queue       = arg_pack_iget_ptr( arg_pack , 0 );
+  const stringlist_type * gen_data_files = arg_pack_iget_const_ptr( arg_pack , 1 );
+  const char * run_path                  = arg_pack_iget_const_ptr( arg_pack , 2 );
+  int iens                               = arg_pack_iget_int( arg_pack , 3 );
+  char * buffer                          = util_malloc( ENKF_TUI_PREFETCH_BUFFER_SIZE );
+  enkf_tui_trace_span_type * span        = enkf_tui_trace_span_begin( "prefetch" , run_path , iens );
+
+  if (util_is_directory( run_path )) {
+    stringlist_type * files = stringlist_alloc_new();
+    stringlist_select_matching_files( files , run_path , "*" );
+
+    for (int i=0; i < stringlist_get_size( files ); i++) {
+      const char * filename = stringlist_iget( files , i );
+      bool fmt_file;
+      int report_nr;
+      ecl_file_enum file_type = ecl_util_get_file_type( filename , &fmt_file , &report_nr );
+
+      if ((file_type == ECL_SUMMARY_FILE) || (file_type == ECL_UNIFIED_SUMMARY_FILE) || (file_type == ECL_SUMMARY_HEADER_FILE))
+        enkf_tui_trace_span_add_bytes( span , enkf_tui_run_prefetch_file( filename , buffer ) , 0 );
+    }
+    stringlist_free( files );
+
+    for (int i=0; i < stringlist_get_size( gen_data_files ); i++) {
+      char * filename = util_alloc_filename( run_path , stringlist_iget( gen_data_files , i ) , NULL );
+      enkf_tui_trace_span_add_bytes( span , enkf_tui_run_prefetch_file( filename , buffer ) , 0 );
+      free( filename );
+    }
+  }
+
+  enkf_tui_trace_span_end( span );
+  free( buffer );
+  enkf_tui_load_queue_push( queue , queue->prefetched , iens );
+  return NULL;
+}
+
+
+static void * enkf_tui_run_load_mt( void * arg ) {
+  arg_pack_type * arg_pack         = arg_pack_safe_cast( arg );
+  enkf_tui_load_queue_type * queue = arg_pack_iget_ptr( arg_pack , 0 );
+  enkf_state_type * enkf_state     = arg_pack_iget_ptr( arg_pack , 1 );
+  run_arg_type * run_arg           = arg_pack_iget_ptr( arg_pack , 2 );
+  stringlist_type * msg_list       = arg_pack_iget_ptr( arg_pack , 3 );
+  int * result                     = arg_pack_iget_ptr( arg_pack , 4 );
+  int iens                         = arg_pack_iget_int( arg_pack , 5 );
+
+  {
+    enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "load_from_forward_model" , NULL , iens );
+    *result = enkf_state_load_from_forward_model( enkf_state , run_arg , msg_list );
+    enkf_tui_trace_span_end( span );
+  }
+  enkf_tui_load_queue_push( queue , queue->loaded , iens );
+  return NULL;
+}
+
+
+/**
+   The relative names of the GEN_DATA result files, these are the
+   same for all realizations.
+*/
+
+static stringlist_type * enkf_tui_run_alloc_gen_data_files( const ensemble_config_type * ensemble_config ) {
+  stringlist_type * gen_data_files = stringlist_alloc_new();
+  stringlist_type * keys = ensemble_config_alloc_keylist_from_impl_type( ensemble_config , GEN_DATA );
+
+  for (int ikey = 0; ikey < stringlist_get_size( keys ); ikey++) {
+    const enkf_config_node_type * config_node = ensemble_config_get_node( ensemble_config , stringlist_iget( keys , ikey ));
+    const char * infile_fmt = enkf_config_node_get_enkf_infile( config_node );
+
+    if (infile_fmt != NULL) {
+      const gen_data_config_type * gen_data_config = enkf_config_node_get_ref( config_node );
+      for (int i = 0; i < gen_data_config_num_report_step( gen_data_config ); i++)
+        stringlist_append_owned_ref( gen_data_files , util_alloc_sprintf( infile_fmt , gen_data_config_iget_report_step( gen_data_config , i )));
+    }
+  }
+  stringlist_free( keys );
+  return gen_data_files;
+}
+
+
+static void enkf_tui_run_load_pipeline( enkf_main_type * enkf_main , int iter , const bool_vector_type * iactive ) {
+  const int ens_size                     = enkf_main_get_ensemble_size( enkf_main );
+  const model_config_type * model_config = enkf_main_get_model_config( enkf_main );
+  enkf_fs_type * fs                      = enkf_main_tui_get_fs( enkf_main );
+  stringlist_type * gen_data_files       = enkf_tui_run_alloc_gen_data_files( enkf_main_get_ensemble_config( enkf_main ));
+  thread_pool_type * io_tp               = thread_pool_alloc( ENKF_TUI_LOAD_IO_THREADS , true );
+  thread_pool_type * load_tp             = thread_pool_alloc( enkf_tui_util_get_num_threads() , true );
+  run_arg_type ** run_args               = util_calloc( ens_size , sizeof * run_args );
+  stringlist_type ** msg_lists           = util_calloc( ens_size , sizeof * msg_lists );
+  arg_pack_type ** prefetch_args         = util_calloc( ens_size , sizeof * prefetch_args );
+  arg_pack_type ** load_args             = util_calloc( ens_size , sizeof * load_args );
+  int * results                          = util_calloc( ens_size , sizeof * results );
+  int num_active                         = 0;
+  int num_complete                       = 0;
+  int num_failed                         = 0;
+  double start_time                      = enkf_tui_util_wallclock();
+  enkf_tui_load_queue_type queue;
+
+  pthread_mutex_init( &queue.mutex , NULL );
+  pthread_cond_init( &queue.cond , NULL );
+  queue.prefetched = int_vector_alloc( 0 , 0 );
+  queue.loaded     = int_vector_alloc( 0 , 0 );
+
+  for (int iens = 0; iens < ens_size; iens++) {
+    run_args[iens] = NULL;
+    if (bool_vector_safe_iget( iactive , iens )) {
+      enkf_state_type * enkf_state = enkf_main_iget_state( enkf_main , iens );
+      char * run_path = ert_run_context_alloc_runpath( iens , model_config_get_runpath_fmt( model_config ) , enkf_state_get_subst_list( enkf_state ) , iter );
+
+      run_args[iens]  = run_arg_alloc_ENSEMBLE_EXPERIMENT( fs , iens , iter , run_path );
+      msg_lists[iens] = stringlist_alloc_new();
+      results[iens]   = 0;
+
+      prefetch_args[iens] = arg_pack_alloc();
+      arg_pack_append_ptr( prefetch_args[iens] , &queue );
+      arg_pack_append_const_ptr( prefetch_args[iens] , gen_data_files );
+      arg_pack_append_owned_ptr( prefetch_args[iens] , run_path , free );
+      arg_pack_append_int( prefetch_args[iens] , iens );
+
+      load_args[iens] = arg_pack_alloc();
+      arg_pack_append_ptr( load_args[iens] , &queue );
+      arg_pack_append_ptr( load_args[iens] , enkf_state );
+      arg_pack_append_ptr( load_args[iens] , run_args[iens] );
+      arg_pack_append_ptr( load_args[iens] , msg_lists[iens] );
+      arg_pack_append_ptr( load_args[iens] , &results[iens] );
+      arg_pack_append_int( load_args[iens] , iens );
+
+      thread_pool_add_job( io_tp , enkf_tui_run_prefetch_mt , prefetch_args[iens] );
+      num_active++;
+    }
+  }
+
+  while (num_complete < num_active) {
+    int_vector_type * prefetched;
+    int_vector_type * loaded;
+
+    pthread_mutex_lock( &queue.mutex );
+    while ((int_vector_size( queue.prefetched ) == 0) && (int_vector_size( queue.loaded ) == 0))
+      pthread_cond_wait( &queue.cond , &queue.mutex );
+
+    prefetched = int_vector_alloc_copy( queue.prefetched );
+    loaded     = int_vector_alloc_copy( queue.loaded );
+    int_vector_reset( queue.prefetched );
+    int_vector_reset( queue.loaded );
+    pthread_mutex_unlock( &queue.mutex );
+
+    for (int i = 0; i < int_vector_size( prefetched ); i++)
+      thread_pool_add_job( load_tp , enkf_tui_run_load_mt , load_args[ int_vector_iget( prefetched , i ) ] );
+
+    for (int i = 0; i < int_vector_size( loaded ); i++) {
+      int iens = int_vector_iget( loaded , i );
+
+      enkf_tui_display_load_msg( iens , msg_lists[iens] );
+      num_complete++;
+      /* The result is a set of flags; e.g. REPORT_STEP_INCOMPATIBLE alone is not a failure. */
+      if ((results[iens] & LOAD_FAILURE) != 0) {
+        num_failed++;
+        printf("[%03d] : load failure                  (%d/%d)\n" , iens , num_complete , num_active );
+      } else
+        printf("[%03d] : loaded                        (%d/%d)\n" , iens , num_complete , num_active );
+      fflush( stdout );
+    }
+
+    int_vector_free( prefetched );
+    int_vector_free( loaded );
+  }
+
+  thread_pool_join( io_tp );
+  thread_pool_join( load_tp );
+  enkf_fs_fsync( fs );
+  printf("Loaded %d/%d realizations in %.1f seconds.\n" , num_active - num_failed , num_active , enkf_tui_util_wallclock() - start_time);
+
+  for (int iens = 0; iens < ens_size; iens++) {
+    if (run_args[iens] != NULL) {
+      arg_pack_free( prefetch_args[iens] );
+      arg_pack_free( load_args[iens] );
+      stringlist_free( msg_lists[iens] );
+      run_arg_free( run_args[iens] );
+    }
+  }
+
+  int_vector_free( queue.prefetched );
+  int_vector_free( queue.loaded );
+  pthread_cond_destroy( &queue.cond );
+  pthread_mutex_destroy( &queue.mutex );
+
+  free( results );
+  free( load_args );
+  free( prefetch_args );
+  free( msg_lists );
+  free( run_args );
+  thread_pool_free( load_tp );
+  thread_pool_free( io_tp );
+  stringlist_free( gen_data_files );
+}
+
+#undef ENKF_TUI_PREFETCH_BUFFER_SIZE
+#undef ENKF_TUI_LOAD_IO_THREADS
+
+
 void enkf_tui_run_manual_load__( void * arg ) {
   enkf_main_type * enkf_main = enkf_main_safe_cast( arg );
   const int ens_size         = enkf_main_get_ensemble_size( enkf_main );
@@ -165,26 +437,8 @@ void enkf_tui_run_manual_load__( void * arg ) {
   }
 
 
-  if (bool_vector_count_equal( iactive , true )) {
-    stringlist_type ** realizations_msg_list = util_calloc( ens_size , sizeof * realizations_msg_list );
-    int iens = 0;
-    for (; iens < ens_size; ++iens) {
-      realizations_msg_list[iens] = stringlist_alloc_new();
-    }
-
-    enkf_main_load_from_forward_model(enkf_main, iter , iactive, realizations_msg_list);
-
-    for (iens = 0; iens < ens_size; ++iens) {
-      stringlist_type * msg_list = realizations_msg_list[iens];
-      if (bool_vector_iget(iactive, iens)) {
-        if (stringlist_get_size( msg_list )) {
-          enkf_tui_display_load_msg( iens , msg_list );
-        }
-      }
-      stringlist_free(msg_list);
-    }
-    free(realizations_msg_list);
-  }
+  if (bool_vector_count_equal( iactive , true ))
+    enkf_tui_run_load_pipeline( enkf_main , iter , iactive );
 
   bool_vector_free( iactive );
 }
@@ -0,0 +1,302 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_stat.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <ert/util/util.h>
+#include <ert/util/double_vector.h>
+
+#include <ert/enkf/field.h>
+
+#include <enkf_tui_stat.h>
+#include <enkf_tui_kernel.h>
+
+/**
+   This file implements per cell ensemble statistics of a field,
+   accumulated one realization at a time, i.e. without holding the
+   full ensemble in memory:
+
+    - Mean and standard deviation are accumulated with the online
+      algorithm of Welford.
+
+    - The quantiles are estimated with the P^2 algorithm of Jain and
+      Chlamtac (1985). For each cell and quantile five markers are
+      kept; the height of the middle marker is the estimate. The
+      markers are exact as long as no more than five realizations
+      have been added.
+
+   Since every cell sees the same number of realizations the position
+   of the first and last marker, and all the desired marker
+   positions, are shared between the cells; only the heights and the
+   three interior positions are stored per cell. The memory usage is
+   therefor 24 bytes per cell, plus 52 bytes per cell and quantile.
+*/
+
+#define NUM_MARKERS 5
+
+struct enkf_tui_stat_struct {
+  int       data_size;
+  int       count;
+  int       num_quantiles;
+  double  * quantile_value;   /* The quantiles to estimate, in [0,1]. */
+  double  * mean;
+  double  * M2;
+  double  * values;           /* Scratch: the field currently being added. */
+  double ** height;           /* height[iq][ NUM_MARKERS * cell + i ] */
+  int    ** pos;              /* pos[iq][ 3 * cell + i - 1 ] for the interior markers i = 1,2,3. */
+};
+
+
+
+enkf_tui_stat_type * enkf_tui_stat_alloc( int data_size , const double_vector_type * quantiles ) {
+  enkf_tui_stat_type * stat = util_malloc( sizeof * stat );
+  int iq;
+
+  stat->data_size      = data_size;
+  stat->count          = 0;
+  stat->num_quantiles  = double_vector_size( quantiles );
+  stat->quantile_value = util_calloc( stat->num_quantiles , sizeof * stat->quantile_value );
+  stat->mean           = util_calloc( data_size , sizeof * stat->mean );
+  stat->M2             = util_calloc( data_size , sizeof * stat->M2 );
+  stat->values         = util_calloc( data_size , sizeof * stat->values );
+  stat->height         = util_calloc( stat->num_quantiles , sizeof * stat->height );
+  stat->pos            = util_calloc( stat->num_quantiles , sizeof * stat->pos );
+
+  for (iq = 0; iq < stat->num_quantiles; iq++) {
+    stat->quantile_value[iq] = double_vector_iget( quantiles , iq );
+    stat->height[iq]         = util_calloc( NUM_MARKERS * data_size , sizeof * stat->height[iq] );
+    stat->pos[iq]            = util_calloc( 3 * data_size , sizeof * stat->pos[iq] );
+  }
+  return stat;
+}
+
+
+void enkf_tui_stat_free( enkf_tui_stat_type * stat ) {
+  int iq;
+  for (iq = 0; iq < stat->num_quantiles; iq++) {
+    free( stat->height[iq] );
+    free( stat->pos[iq] );
+  }
+  free( stat->height );
+  free( stat->pos );
+  free( stat->quantile_value );
+  free( stat->mean );
+  free( stat->M2 );
+  free( stat->values );
+  free( stat );
+}
+
+
+int enkf_tui_stat_get_count( const enkf_tui_stat_type * stat ) {
+  return stat->count;
+}
+
+
+int enkf_tui_stat_get_num_quantiles( const enkf_tui_stat_type * stat ) {
+  return stat->num_quantiles;
+}
+
+
+double enkf_tui_stat_iget_quantile_value( const enkf_tui_stat_type * stat , int iq ) {
+  return stat->quantile_value[iq];
+}
+
+
+/*****************************************************************/
+
+
+static int enkf_tui_stat_cmp_double( const void * arg1 , const void * arg2 ) {
+  double d1 = *((const double *) arg1);
+  double d2 = *((const double *) arg2);
+  if (d1 < d2)
+    return -1;
+  else if (d1 > d2)
+    return 1;
+  else
+    return 0;
+}
+
+
+/*
+  The desired (real valued) position of marker i when count
+  observations have been added; the positions are zero based.
+*/
+
+static double enkf_tui_stat_desired_pos( double p , int count , int i ) {
+  static const double f_lower[NUM_MARKERS] = {0 , 0   , 0 , 0.5 , 1};
+  static const double f_p[NUM_MARKERS]     = {0 , 0.5 , 1 , 0.5 , 0};
+
+  return (count - 1) * (f_lower[i] + f_p[i] * p);
+}
+
+
+static void enkf_tui_stat_P2_update( double * q , int * inner_pos , double p , int count , double x) {
+  int n[NUM_MARKERS];
+  int i , k;
+
+  n[0] = 0;
+  n[1] = inner_pos[0];
+  n[2] = inner_pos[1];
+  n[3] = inner_pos[2];
+  n[4] = count - 2;      /* Position of the last marker before x is added. */
+
+  if (x < q[0]) {
+    q[0] = x;
+    k = 0;
+  } else if (x >= q[4]) {
+    q[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (x >= q[k + 1])
+      k++;
+  }
+
+  for (i = k + 1; i < NUM_MARKERS; i++)
+    n[i]++;
+
+  for (i = 1; i <= 3; i++) {
+    double d = enkf_tui_stat_desired_pos( p , count , i ) - n[i];
+    if ((d >= 1 && (n[i + 1] - n[i]) > 1) || (d <= -1 && (n[i - 1] - n[i]) < -1)) {
+      int s = (d > 0) ? 1 : -1;
+      double qp = q[i] + 1.0 * s / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+
+      if (q[i - 1] < qp && qp < q[i + 1])
+        q[i] = qp;
+      else
+        q[i] = q[i] + 1.0 * s * (q[i + s] - q[i]) / (n[i + s] - n[i]);
+      n[i] += s;
+    }
+  }
+
+  inner_pos[0] = n[1];
+  inner_pos[1] = n[2];
+  inner_pos[2] = n[3];
+}
+
+
+/*
+  The Welford update is a separate loop over plain arrays, so that it
+  can be vectorized; the P^2 update has too much branching for that.
+*/
+
+static void enkf_tui_stat_update_moments( int data_size , int count , const double * values , double * mean , double * M2 ) {
+  for (int cell = 0; cell < data_size; cell++) {
+    double delta = values[cell] - mean[cell];
+
+    mean[cell] += delta / count;
+    M2[cell]   += delta * (values[cell] - mean[cell]);
+  }
+}
+
+
+/**
+   Adds one realization; values holds the data_size values of the
+   realization.
+*/
+
+void enkf_tui_stat_add_values( enkf_tui_stat_type * stat , const double * values ) {
+  int cell , iq;
+
+  stat->count++;
+  enkf_tui_stat_update_moments( stat->data_size , stat->count , values , stat->mean , stat->M2 );
+
+  for (cell = 0; cell < stat->data_size; cell++) {
+    double x = values[cell];
+
+    for (iq = 0; iq < stat->num_quantiles; iq++) {
+      double * q = &stat->height[iq][ NUM_MARKERS * cell ];
+      if (stat->count <= NUM_MARKERS) {
+        q[ stat->count - 1 ] = x;
+        if (stat->count == NUM_MARKERS) {
+          int * inner_pos = &stat->pos[iq][ 3 * cell ];
+          qsort( q , NUM_MARKERS , sizeof * q , enkf_tui_stat_cmp_double );
+          inner_pos[0] = 1;
+          inner_pos[1] = 2;
+          inner_pos[2] = 3;
+        }
+      } else
+        enkf_tui_stat_P2_update( q , &stat->pos[iq][ 3 * cell ] , stat->quantile_value[iq] , stat->count , x );
+    }
+  }
+}
+
+
+void enkf_tui_stat_add_field( enkf_tui_stat_type * stat , const field_type * field ) {
+  enkf_tui_kernel_load_field( field , stat->data_size , stat->values );
+  enkf_tui_stat_add_values( stat , stat->values );
+}
+
+
+/*****************************************************************/
+
+
+void enkf_tui_stat_get_mean( const enkf_tui_stat_type * stat , double * values ) {
+  memcpy( values , stat->mean , stat->data_size * sizeof * values );
+}
+
+
+/**
+   The sample standard deviation, i.e. normalized with (count - 1).
+*/
+
+void enkf_tui_stat_get_std( const enkf_tui_stat_type * stat , double * values ) {
+  int cell;
+  for (cell = 0; cell < stat->data_size; cell++) {
+    if (stat->count > 1)
+      values[cell] = sqrt( stat->M2[cell] / (stat->count - 1));
+    else
+      values[cell] = 0;
+  }
+}
+
+
+/*
+  With no more than NUM_MARKERS realizations the markers are the raw
+  observations, and the quantile is found by linear interpolation
+  between the sorted values. The P^2 estimate (the middle marker) is
+  only used when more realizations have been added; with exactly
+  NUM_MARKERS realizations the middle marker is the median for all
+  the quantiles.
+*/
+
+void enkf_tui_stat_iget_quantile( const enkf_tui_stat_type * stat , int iq , double * values ) {
+  int cell;
+  for (cell = 0; cell < stat->data_size; cell++) {
+    const double * q = &stat->height[iq][ NUM_MARKERS * cell ];
+    if (stat->count > NUM_MARKERS)
+      values[cell] = q[2];
+    else if (stat->count > 0) {
+      double sorted[NUM_MARKERS];
+      double rank = stat->quantile_value[iq] * (stat->count - 1);
+      int lower   = (int) floor( rank );
+      int upper   = util_int_min( lower + 1 , stat->count - 1 );
+
+      memcpy( sorted , q , stat->count * sizeof * sorted );
+      qsort( sorted , stat->count , sizeof * sorted , enkf_tui_stat_cmp_double );
+      values[cell] = sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+    } else
+      values[cell] = 0;
+  }
+}
+
+#undef NUM_MARKERS
@@ -0,0 +1,39 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_stat.h' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#ifndef ERT_ENKF_TUI_STAT_H
+#define ERT_ENKF_TUI_STAT_H
+
+#include <ert/util/double_vector.h>
+
+#include <ert/enkf/field.h>
+
+typedef struct enkf_tui_stat_struct enkf_tui_stat_type;
+
+enkf_tui_stat_type * enkf_tui_stat_alloc( int data_size , const double_vector_type * quantiles );
+void                 enkf_tui_stat_free( enkf_tui_stat_type * stat );
+void                 enkf_tui_stat_add_values( enkf_tui_stat_type * stat , const double * values );
+void                 enkf_tui_stat_add_field( enkf_tui_stat_type * stat , const field_type * field );
+int                  enkf_tui_stat_get_count( const enkf_tui_stat_type * stat );
+int                  enkf_tui_stat_get_num_quantiles( const enkf_tui_stat_type * stat );
+double               enkf_tui_stat_iget_quantile_value( const enkf_tui_stat_type * stat , int iq );
+void                 enkf_tui_stat_get_mean( const enkf_tui_stat_type * stat , double * values );
+void                 enkf_tui_stat_get_std( const enkf_tui_stat_type * stat , double * values );
+void                 enkf_tui_stat_iget_quantile( const enkf_tui_stat_type * stat , int iq , double * values );
+
+#endif
@@ -26,14 +26,19 @@
 #include <ert/util/menu.h>
 #include <ert/util/arg_pack.h>
 #include <ert/util/msg.h>
+#include <ert/util/double_vector.h>
 
 #include <ert/enkf/enkf_main.h>
+#include <ert/enkf/enkf_node.h>
 #include <ert/enkf/enkf_obs.h>
 #include <ert/enkf/block_obs.h>
 #include <ert/enkf/field_config.h>
 #include <ert/enkf/obs_vector.h>
 #include <ert/enkf/ensemble_config.h>
 #include <ert/enkf/gen_kw_config.h>
+#include <ert/enkf/gen_kw.h>
+#include <ert/enkf/gen_data.h>
+#include <ert/enkf/field.h>
 
 #include <enkf_tui_util.h>
 #include <enkf_tui_help.h>
@@ -43,6 +48,114 @@
         
            
 
+/**
+   Extracts the value of index_key from a node which has already been
+   loaded; this is what enkf_node_user_get() does after it has loaded
+   the node. The implementation types without a public user_get
+   function fall back to enkf_node_user_get(), which loads the node
+   again.
+*/
+
+static bool enkf_tui_table_user_get_loaded( enkf_node_type * node , enkf_fs_type * fs , const char * index_key , node_id_type node_id , double * value) {
+  switch (enkf_node_get_impl_type( node )) {
+  case GEN_KW:
+    return gen_kw_user_get( enkf_node_value_ptr( node ) , index_key , node_id.report_step , value );
+  case FIELD:
+    return field_user_get( enkf_node_value_ptr( node ) , index_key , node_id.report_step , value );
+  case GEN_DATA:
+    return gen_data_user_get( enkf_node_value_ptr( node ) , index_key , node_id.report_step , value );
+  default:
+    return enkf_node_user_get( node , fs , index_key , node_id , value );
+  }
+}
+
+
+/**
+   Fills the columns of all the keys ikey_list[0 .. num_group_keys - 1]
+   which share the node 'node'. When the table runs over report steps
+   (i.e. !ens_plot) and the node is stored as a vector (i.e. SUMMARY)
+   the complete time series of each key is loaded in one operation;
+   otherwise the node is loaded once for every element of the columns
+   and all the keys are extracted from that load. The valid vectors
+   are set to true for the elements where data was found.
+*/
+
+static void enkf_tui_table_load_columns( enkf_node_type * node , enkf_fs_type * fs , int num_group_keys , const int * ikey_list , char ** index_keys , bool ens_plot , int iens1 , int iens2 , int step1 , int step2 , double ** data , bool ** valid , double_vector_type * vector) {
+  int iens, step, igroup;
+  int row;
+
+  if (!ens_plot && enkf_node_vector_storage( node )) {
+    for (igroup = 0; igroup < num_group_keys; igroup++) {
+      int ikey = ikey_list[igroup];
+      row = 0;
+      double_vector_reset( vector );
+      if (enkf_node_user_get_vector( node , fs , index_keys[ikey] , iens1 , vector )) {
+        for (step = step1; step < step2; step++) {
+          valid[ikey][row] = (step < double_vector_size( vector ));
+          if (valid[ikey][row])
+            data[ikey][row] = double_vector_iget( vector , step );
+          row++;
+        }
+      } else {
+        for (step = step1; step < step2; step++)
+          valid[ikey][row++] = false;
+      }
+    }
+  } else {
+    row = 0;
+    for (iens = iens1; iens < iens2; iens ++) {
+      for (step = step1; step < step2; step++) {
+        node_id_type node_id = {.report_step = step, 
+                                .iens = iens };
+        bool loaded = enkf_node_try_load( node , fs , node_id );
+
+        for (igroup = 0; igroup < num_group_keys; igroup++) {
+          int ikey = ikey_list[igroup];
+          if (loaded)
+            valid[ikey][row] = enkf_tui_table_user_get_loaded( node , fs , index_keys[ikey] , node_id , &data[ikey][row]);
+          else
+            valid[ikey][row] = false;
+        }
+        row++;
+      }
+    }
+  }
+}
+
+
+/**
+   Binary columnar version of the table. The layout of the file is:
+
+      int      num_keys
+      int      num_rows
+      string   index_name
+      string   key[0], key[1], ... key[num_keys - 1]
+      int      index[0 .. num_rows - 1]
+      double   data[0][0 .. num_rows - 1]
+      ...
+      double   data[num_keys - 1][0 .. num_rows - 1]
+
+   The int and string elements are written with util_fwrite_int() and
+   util_fwrite_string(). Keys which could not be found are written as
+   columns of -1.
+*/
+
+static void enkf_tui_table_fwrite( const int * index , const double ** data , const char * index_name , const char ** user_keys , int num_rows , int num_keys , FILE * stream) {
+  int ikey;
+
+  util_fwrite_int( num_keys , stream );
+  util_fwrite_int( num_rows , stream );
+  util_fwrite_string( index_name , stream );
+  for (ikey = 0; ikey < num_keys; ikey++)
+    util_fwrite_string( user_keys[ikey] , stream );
+
+  util_fwrite( index , sizeof * index , num_rows , stream , __func__ );
+  for (ikey = 0; ikey < num_keys; ikey++)
+    util_fwrite( data[ikey] , sizeof * data[ikey] , num_rows , stream , __func__ );
+}
+
+
+
 static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bool ens_plot) {
   const ensemble_config_type * ensemble_config = enkf_main_get_ensemble_config(enkf_main);
   enkf_fs_type               * fs              = enkf_main_tui_get_fs(enkf_main);
@@ -59,11 +172,14 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   bool     * active;  
   enkf_config_node_type ** config_nodes;
   enkf_node_type        ** nodes;
+  int                    * node_owner;
 
   const int prompt_len = 50;
   const char * keylist_prompt  = "Table headings: KEY1:INDEX1   KEY2:INDEX2 ....";
   const char * gen_kw_prompt   = "GEN_KW Parameter";
   const char * file_prompt     = "File to save in (blank for nothing) ";
+  const char * format_prompt   = "File format (1: text  2: binary columns)";
+  bool binary_output           = false;
   
   if (gen_kw_table) {
     char * key;
@@ -103,8 +219,10 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   util_printf_prompt(file_prompt , prompt_len , '=' , "=> ");
   {
     char * filename = util_alloc_stdin_line( );
-    if (filename != NULL)
+    if (filename != NULL) {
+      binary_output = (util_scanf_int_with_limits(format_prompt , prompt_len , 1 , 2) == 2);
       stream = util_mkdir_fopen( filename , "w");
+    }
     free( filename );
   }
 
@@ -112,10 +230,26 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   nodes        = util_calloc( num_keys , sizeof * nodes        );
   config_nodes = util_calloc( num_keys , sizeof * config_nodes );
   index_keys   = util_calloc( num_keys , sizeof * index_keys   );
+  /*
+     Keys on the same config node, e.g. several cells of one FIELD,
+     share one enkf_node instance so that the node is only loaded once
+     per (iens, step); node_owner[ikey] is the first key of the group.
+  */
+  node_owner   = util_calloc( num_keys , sizeof * node_owner   );
   for (ikey  = 0; ikey < num_keys; ikey++) {
     config_nodes[ikey] = (enkf_config_node_type *) ensemble_config_user_get_node( ensemble_config , user_keys[ikey] , &index_keys[ikey]);
+    node_owner[ikey]   = ikey;
     if (config_nodes[ikey] != NULL) {
-      nodes[ikey]  = enkf_node_alloc( config_nodes[ikey] );
+      for (int iprev = 0; iprev < ikey; iprev++) {
+        if (config_nodes[iprev] == config_nodes[ikey]) {
+          node_owner[ikey] = iprev;
+          break;
+        }
+      }
+      if (node_owner[ikey] == ikey)
+        nodes[ikey]  = enkf_node_alloc( config_nodes[ikey] );
+      else
+        nodes[ikey]  = nodes[ node_owner[ikey] ];
       active[ikey] = true;
     } else {
       fprintf(stderr,"** Warning: could not lookup node: %s \n",user_keys[ikey]);
@@ -147,41 +281,53 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   
   {
     int active_length = 0;
-    int total_line_count = 0;
-    double line[num_keys];
-    int iens, step;
+    bool ** valid = util_calloc( num_keys , sizeof * valid );
+    double_vector_type * vector = double_vector_alloc( 0 , 0 );
+    int * ikey_list = util_calloc( num_keys , sizeof * ikey_list );
+    int row;
     
-    for (iens = iens1; iens < iens2; iens ++) {
-      for (step = step1; step < step2; step++) {
-        int line_count = 0;
-        
-        for (ikey = 0; ikey < num_keys; ikey++) {
-          if (active[ikey]) {
-            node_id_type node_id = {.report_step = step, 
-                                    .iens = iens };
-            if (enkf_node_user_get( nodes[ikey] , fs , index_keys[ikey] , node_id , &line[ikey]))
-              line_count++;
-            else
-              line[ikey] = -1;
-          }
-        }
-        
-        if (line_count > 0) {
-          for (ikey=0; ikey < num_keys; ikey++) 
-            data[ikey][active_length] = line[ikey];
-          index[active_length] = total_line_count;
-          active_length++;
-        }
-        
-        total_line_count++;
+    for (ikey = 0; ikey < num_keys; ikey++)
+      valid[ikey] = util_calloc( length , sizeof * valid[ikey] );
+
+    for (ikey = 0; ikey < num_keys; ikey++) {
+      if (active[ikey] && (node_owner[ikey] == ikey)) {
+        int num_group_keys = 0;
+        for (int jkey = ikey; jkey < num_keys; jkey++)
+          if (active[jkey] && (node_owner[jkey] == ikey))
+            ikey_list[num_group_keys++] = jkey;
+
+        enkf_tui_table_load_columns( nodes[ikey] , fs , num_group_keys , ikey_list , index_keys , ens_plot , iens1 , iens2 , step1 , step2 , data , valid , vector);
+      }
+    }
+    free( ikey_list );
+    double_vector_free( vector );
+
+    /* Compress the table in place; rows without any data are removed. */
+    for (row = 0; row < length; row++) {
+      int line_count = 0;
+      
+      for (ikey = 0; ikey < num_keys; ikey++) 
+        if (active[ikey] && valid[ikey][row])
+          line_count++;
+      
+      if (line_count > 0) {
+        for (ikey=0; ikey < num_keys; ikey++) 
+          data[ikey][active_length] = (active[ikey] && valid[ikey][row]) ? data[ikey][row] : -1;
+        index[active_length] = row;
+        active_length++;
       }
     }
+
+    for (ikey = 0; ikey < num_keys; ikey++)
+      free( valid[ikey] );
+    free( valid );
     
     if (stream != NULL) {
-      if (ens_plot) 
-        enkf_util_fprintf_data( index , (const double **) data , "Realization"   , (const char **) user_keys , active_length , num_keys , active , true , stream);
+      const char * index_name = ens_plot ? "Realization" : "Report-step";
+      if (binary_output)
+        enkf_tui_table_fwrite( index , (const double **) data , index_name , (const char **) user_keys , active_length , num_keys , stream);
       else
-        enkf_util_fprintf_data( index , (const double **) data , "Report-step" , (const char **) user_keys , active_length , num_keys , active , false , stream);
+        enkf_util_fprintf_data( index , (const double **) data , index_name , (const char **) user_keys , active_length , num_keys , active , ens_plot , stream);
       fclose(stream);
     }
 
@@ -193,7 +339,7 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   }
 
   for (ikey = 0; ikey < num_keys; ikey++) {
-    if (active[ikey])
+    if (active[ikey] && (node_owner[ikey] == ikey))
       enkf_node_free( nodes[ikey] );
 
     free(index_keys[ikey]);
@@ -205,6 +351,7 @@ static void enkf_tui_table__(enkf_main_type * enkf_main , bool gen_kw_table , bo
   free( index_keys);
   free( data );
   free( nodes );
+  free( node_owner );
   free( config_nodes );
 }
 
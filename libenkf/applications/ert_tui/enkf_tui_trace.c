@@ -0,0 +1,188 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_trace.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <ert/util/util.h>
+#include <ert/util/vector.h>
+
+#include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
+
+/**
+   Lightweight tracing of tui operations. When tracing has been
+   enabled with enkf_tui_trace_init() every span is recorded in memory
+   as a Chrome trace "complete" event, and all the events are written
+   as one Chrome/Perfetto trace JSON file by enkf_tui_trace_close().
+   Spans on the same thread nest by time, so the trace viewers show
+   the nesting without explicit parent links.
+
+   When tracing is not enabled enkf_tui_trace_span_begin() returns
+   NULL, and the other span functions accept NULL; the cost of an
+   untraced span is one uncontended mutex lock.
+*/
+
+struct enkf_tui_trace_span_struct {
+  char   * name;
+  char   * key;
+  int      iens;
+  int      tid;
+  double   start;
+  double   duration;
+  size_t   bytes_read;
+  size_t   bytes_written;
+};
+
+
+static pthread_mutex_t   trace_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static char            * trace_file     = NULL;
+static vector_type     * trace_events   = NULL;
+static double            trace_start    = 0;
+static int               trace_next_tid = 1;
+static __thread int      trace_tid      = 0;
+
+
+static void enkf_tui_trace_span_free__( void * arg ) {
+  enkf_tui_trace_span_type * span = arg;
+  free( span->name );
+  util_safe_free( span->key );
+  free( span );
+}
+
+
+static void enkf_tui_trace_atexit( void ) {
+  enkf_tui_trace_close( );
+}
+
+
+void enkf_tui_trace_init( const char * filename ) {
+  pthread_mutex_lock( &trace_mutex );
+  if (trace_file == NULL) {
+    trace_file   = util_alloc_string_copy( filename );
+    trace_events = vector_alloc_new( );
+    trace_start  = enkf_tui_util_wallclock( );
+    atexit( enkf_tui_trace_atexit );
+  }
+  pthread_mutex_unlock( &trace_mutex );
+}
+
+
+bool enkf_tui_trace_enabled( void ) {
+  bool enabled;
+  pthread_mutex_lock( &trace_mutex );
+  enabled = (trace_file != NULL);
+  pthread_mutex_unlock( &trace_mutex );
+  return enabled;
+}
+
+
+enkf_tui_trace_span_type * enkf_tui_trace_span_begin( const char * name , const char * key , int iens ) {
+  if (!enkf_tui_trace_enabled( ))
+    return NULL;
+  else {
+    enkf_tui_trace_span_type * span = util_malloc( sizeof * span );
+    span->name          = util_alloc_string_copy( name );
+    span->key           = util_alloc_string_copy( key );
+    span->iens          = iens;
+    span->bytes_read    = 0;
+    span->bytes_written = 0;
+    span->duration      = 0;
+
+    if (trace_tid == 0) {
+      pthread_mutex_lock( &trace_mutex );
+      trace_tid = trace_next_tid++;
+      pthread_mutex_unlock( &trace_mutex );
+    }
+    span->tid   = trace_tid;
+    span->start = enkf_tui_util_wallclock( );
+    return span;
+  }
+}
+
+
+void enkf_tui_trace_span_add_bytes( enkf_tui_trace_span_type * span , size_t bytes_read , size_t bytes_written ) {
+  if (span != NULL) {
+    span->bytes_read    += bytes_read;
+    span->bytes_written += bytes_written;
+  }
+}
+
+
+void enkf_tui_trace_span_end( enkf_tui_trace_span_type * span ) {
+  if (span != NULL) {
+    span->duration = enkf_tui_util_wallclock( ) - span->start;
+    pthread_mutex_lock( &trace_mutex );
+    if (trace_events != NULL)
+      vector_append_owned_ref( trace_events , span , enkf_tui_trace_span_free__ );
+    else
+      enkf_tui_trace_span_free__( span );
+    pthread_mutex_unlock( &trace_mutex );
+  }
+}
+
+
+static void enkf_tui_trace_fprintf_span( FILE * stream , const enkf_tui_trace_span_type * span , int pid ) {
+  fprintf( stream , "{\"name\": " );
+  enkf_tui_util_fprintf_json_string( stream , span->name );
+  fprintf( stream , ", \"cat\": \"ert_tui\", \"ph\": \"X\", \"ts\": %.1f, \"dur\": %.1f, \"pid\": %d, \"tid\": %d, \"args\": {" ,
+           1e6 * (span->start - trace_start) , 1e6 * span->duration , pid , span->tid );
+  fprintf( stream , "\"bytes_read\": %zu, \"bytes_written\": %zu" , span->bytes_read , span->bytes_written );
+  if (span->key != NULL) {
+    fprintf( stream , ", \"key\": " );
+    enkf_tui_util_fprintf_json_string( stream , span->key );
+  }
+  if (span->iens >= 0)
+    fprintf( stream , ", \"realization\": %d" , span->iens );
+  fprintf( stream , "}}" );
+}
+
+
+/**
+   Writes the recorded spans and disables tracing; calling
+   enkf_tui_trace_close() more than once, or without a preceeding
+   enkf_tui_trace_init(), is a no-op.
+*/
+
+void enkf_tui_trace_close( void ) {
+  pthread_mutex_lock( &trace_mutex );
+  if (trace_file != NULL) {
+    FILE * stream = util_mkdir_fopen( trace_file , "w" );
+    int pid = getpid( );
+
+    fprintf( stream , "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+    for (int i = 0; i < vector_get_size( trace_events ); i++) {
+      if (i > 0)
+        fprintf( stream , ",\n" );
+      enkf_tui_trace_fprintf_span( stream , vector_iget_const( trace_events , i ) , pid );
+    }
+    fprintf( stream , "\n]}\n" );
+    fclose( stream );
+
+    printf("Trace with %d spans written to: %s \n" , vector_get_size( trace_events ) , trace_file );
+    vector_free( trace_events );
+    free( trace_file );
+    trace_events = NULL;
+    trace_file   = NULL;
+  }
+  pthread_mutex_unlock( &trace_mutex );
+}
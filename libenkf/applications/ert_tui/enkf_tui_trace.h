@@ -0,0 +1,37 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_trace.h' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#ifndef ERT_ENKF_TUI_TRACE_H
+#define ERT_ENKF_TUI_TRACE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define ENKF_TUI_TRACE_ENV "ERT_TUI_TRACE"
+
+typedef struct enkf_tui_trace_span_struct enkf_tui_trace_span_type;
+
+void                       enkf_tui_trace_init( const char * filename );
+bool                       enkf_tui_trace_enabled( void );
+void                       enkf_tui_trace_close( void );
+
+enkf_tui_trace_span_type * enkf_tui_trace_span_begin( const char * name , const char * key , int iens );
+void                       enkf_tui_trace_span_add_bytes( enkf_tui_trace_span_type * span , size_t bytes_read , size_t bytes_written );
+void                       enkf_tui_trace_span_end( enkf_tui_trace_span_type * span );
+
+#endif
@@ -21,11 +21,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #include <ert/util/util.h>
 #include <ert/util/string_util.h>
 #include <ert/util/menu.h>
 #include <ert/util/arg_pack.h>
+#include <ert/util/msg.h>
 
 #include <ert/enkf/enkf_node.h>
 #include <ert/enkf/field.h>
@@ -34,6 +38,8 @@
 #include <ert/enkf/ensemble_config.h>
 #include <ert/enkf/enkf_types.h>
 
+#include <enkf_tui_util.h>
+
 
 /** 
     This file implements various small utility functions for the (text
@@ -268,6 +274,36 @@ int enkf_tui_util_scanf_ijk(const field_config_type * config, int prompt_len) {
 
 
 
+/**
+   Loads the field for node_id and copies the values of the active
+   cells active_index[0..num_cells) into values. The node instance is
+   only used as scratch space, and should be reused between calls.
+   Cells with a negative active index (i.e. inactive cells) get the
+   value -1. Returns false, without touching values, if the field
+   could not be loaded.
+
+   All the cell based exports go through this function. Observe that
+   enkf_fs stores the field data compressed, so the complete field is
+   still read and decompressed; a storage layer with support for
+   partial reads should be plugged in here.
+*/
+
+bool enkf_tui_util_load_field_cells(enkf_fs_type * fs , enkf_node_type * node , node_id_type node_id , int num_cells , const int * active_index , double * values) {
+  if (enkf_node_try_load(node , fs , node_id)) {
+    const field_type * field = enkf_node_value_ptr( node );
+    int i;
+    for (i = 0; i < num_cells; i++) {
+      if (active_index[i] >= 0)
+        values[i] = field_iget_double(field , active_index[i]);
+      else
+        values[i] = -1;
+    }
+    return true;
+  } else
+    return false;
+}
+
+
 /**
    This function runs through all the report steps [step1:step2] for
    member iens, and gets the value of the cell 'get_index'. Current
@@ -286,10 +322,7 @@ void enkf_tui_util_get_time(enkf_fs_type * fs , const enkf_config_node_type * co
   int index = 0;
   for (report_step = step1; report_step <= step2; report_step++) {
     node_id_type node_id = {.report_step = report_step , .iens = iens };
-    if (enkf_node_try_load(node , fs , node_id)) {
-      const field_type * field = enkf_node_value_ptr( node );
-      y[index] = field_iget_double(field , get_index);
-    } else {
+    if (!enkf_tui_util_load_field_cells(fs , node , node_id , 1 , &get_index , &y[index])) {
       fprintf(stderr," ** Warning field:%s is missing for member,report: %d,%d \n",key  , iens , report_step);
       y[index] = -1;
     }
@@ -399,3 +432,140 @@ void enkf_tui_util_msg(const char * fmt , ...) {
 }
 
 
+/*****************************************************************/
+
+/**
+   Wall clock time in seconds, with sub second resolution; only
+   differences between two calls are meaningful.
+*/
+
+double enkf_tui_util_wallclock( void ) {
+  struct timeval tv;
+  gettimeofday( &tv , NULL );
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+
+/**
+   The number of worker threads used by the multithreaded tui
+   operations; this is the number of online cpus on the current host.
+*/
+
+int enkf_tui_util_get_num_threads( void ) {
+  long num_cpu = sysconf( _SC_NPROCESSORS_ONLN );
+  if (num_cpu < 1)
+    num_cpu = 1;
+  return num_cpu;
+}
+
+
+/**
+   Writes s as a JSON string literal, with the quotes, to stream. The
+   characters which JSON does not allow unescaped in a string are
+   escaped.
+*/
+
+void enkf_tui_util_fprintf_json_string( FILE * stream , const char * s ) {
+  fputc( '"' , stream );
+  for (const char * c = s; *c != '\0'; c++) {
+    unsigned char uc = (unsigned char) *c;
+    if ((uc == '"') || (uc == '\\'))
+      fprintf( stream , "\\%c" , uc );
+    else if (uc == '\n')
+      fprintf( stream , "\\n" );
+    else if (uc == '\t')
+      fprintf( stream , "\\t" );
+    else if (uc < 0x20)
+      fprintf( stream , "\\u%04x" , uc );
+    else
+      fputc( uc , stream );
+  }
+  fputc( '"' , stream );
+}
+
+
+/*****************************************************************/
+
+/**
+   Small progress reporter for operations which run over many
+   realizations, possibly from several threads. The progress is shown
+   on a msg_type line as:
+
+      <prefix> 120/500   35.2 real/s   211.4 MB/s
+
+   The enkf_tui_progress_update() function can be called concurrently
+   from several worker threads.
+*/
+
+struct enkf_tui_progress_struct {
+  pthread_mutex_t   mutex;
+  msg_type        * msg;
+  int               total;
+  int               count;
+  size_t            bytes;
+  double            start_time;
+};
+
+
+enkf_tui_progress_type * enkf_tui_progress_alloc( const char * prefix , int total ) {
+  enkf_tui_progress_type * progress = util_malloc( sizeof * progress );
+  pthread_mutex_init( &progress->mutex , NULL );
+  progress->msg        = msg_alloc( prefix , false );
+  progress->total      = total;
+  progress->count      = 0;
+  progress->bytes      = 0;
+  progress->start_time = enkf_tui_util_wallclock( );
+  msg_show( progress->msg );
+  return progress;
+}
+
+
+static void enkf_tui_progress_fprintf__( const enkf_tui_progress_type * progress , char * label , size_t label_size) {
+  double elapsed = enkf_tui_util_wallclock( ) - progress->start_time;
+  if (elapsed <= 0)
+    elapsed = 1e-6;
+
+  if (progress->bytes > 0)
+    snprintf( label , label_size , "%d/%d  %7.2f real/s  %8.2f MB/s" ,
+              progress->count , progress->total ,
+              progress->count / elapsed ,
+              progress->bytes / (1024.0 * 1024.0 * elapsed));
+  else
+    snprintf( label , label_size , "%d/%d  %7.2f real/s" ,
+              progress->count , progress->total ,
+              progress->count / elapsed );
+}
+
+
+void enkf_tui_progress_update( enkf_tui_progress_type * progress , int count , size_t bytes ) {
+  char label[128];
+  pthread_mutex_lock( &progress->mutex );
+  {
+    progress->count += count;
+    progress->bytes += bytes;
+    enkf_tui_progress_fprintf__( progress , label , sizeof label );
+    msg_update( progress->msg , label );
+  }
+  pthread_mutex_unlock( &progress->mutex );
+}
+
+
+double enkf_tui_progress_get_elapsed( const enkf_tui_progress_type * progress ) {
+  return enkf_tui_util_wallclock( ) - progress->start_time;
+}
+
+
+/**
+   Will remove the msg line, and print a one line summary of the
+   complete operation to stdout.
+*/
+
+void enkf_tui_progress_free( enkf_tui_progress_type * progress ) {
+  char label[128];
+  enkf_tui_progress_fprintf__( progress , label , sizeof label );
+  msg_free( progress->msg , true );
+  printf("Completed: %s  (%.2f s)\n", label , enkf_tui_progress_get_elapsed( progress ));
+
+  pthread_mutex_destroy( &progress->mutex );
+  free( progress );
+}
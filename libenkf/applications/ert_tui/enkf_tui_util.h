@@ -19,6 +19,8 @@
 #ifndef ERT_ENKF_TUI_UTIL_H
 #define ERT_ENKF_TUI_UTIL_H
 
+#include <stdio.h>
+
 #include <ert/util/bool_vector.h>
 
 #include <ert/enkf/enkf_types.h>
@@ -27,12 +29,15 @@
 #include <ert/enkf/enkf_config_node.h>
 #include <ert/enkf/ensemble_config.h>
 
+typedef struct enkf_tui_progress_struct enkf_tui_progress_type;
+
 void                          enkf_tui_util_scanf_report_steps(int  , int  , int *  , int * );
 const enkf_config_node_type * enkf_tui_util_scanf_key(const ensemble_config_type *  , int , ert_impl_type ,  enkf_var_type);
 int                           enkf_tui_util_scanf_ijk(const field_config_type * , int);
 void                          enkf_tui_util_scanf_ijk__(const field_config_type * , int  , int * , int * , int *);
 bool                        * enkf_tui_util_scanf_alloc_report_active(int , int );
 bool                        * enkf_tui_util_scanf_alloc_iens_active(int , int , int * , int *);
+bool                          enkf_tui_util_load_field_cells(enkf_fs_type * fs , enkf_node_type * node , node_id_type node_id , int num_cells , const int * active_index , double * values);
 void                          enkf_tui_util_get_time(enkf_fs_type * , const enkf_config_node_type * , enkf_node_type * , int  , int  , int  , int  , double *  , double *  );
 void                          enkf_tui_util_scanf_iens_range(const char * , int  , int  , int *  , int * );
 int                           enkf_tui_util_scanf_report_step(int , const char *  , int );
@@ -42,4 +47,12 @@ int                           enkf_tui_util_scanf_int_with_default(const char *
 int                           enkf_tui_util_scanf_int_with_default_return_to_menu(const char * prompt , int prompt_len , bool * default_used);
 double                        enkf_tui_util_scanf_double_with_lower_limit(const char * prompt , int prompt_len , double min_value);
 bool                          enkf_tui_util_sscanf_active_list( bool_vector_type * iactive , const char * select_string , int ens_size );
+double                        enkf_tui_util_wallclock( void );
+int                           enkf_tui_util_get_num_threads( void );
+void                          enkf_tui_util_fprintf_json_string( FILE * stream , const char * s );
+
+enkf_tui_progress_type      * enkf_tui_progress_alloc( const char * prefix , int total );
+void                          enkf_tui_progress_update( enkf_tui_progress_type * progress , int count , size_t bytes );
+double                        enkf_tui_progress_get_elapsed( const enkf_tui_progress_type * progress );
+void                          enkf_tui_progress_free( enkf_tui_progress_type * progress );
 #endif
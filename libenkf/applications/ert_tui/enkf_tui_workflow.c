@@ -21,15 +21,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #include <ert/util/util.h>
 #include <ert/util/menu.h>
 #include <ert/util/thread_pool.h>
 #include <ert/util/arg_pack.h>
 #include <ert/util/bool_vector.h>
+#include <ert/util/int_vector.h>
+#include <ert/util/stringlist.h>
+#include <ert/util/string_util.h>
 
 #include <ert/config/config_error.h>
 
+#include <ert/job_queue/workflow.h>
+#include <ert/job_queue/workflow_job.h>
+
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_fs.h>
 #include <ert/enkf/ensemble_config.h>
@@ -40,8 +53,577 @@
 #include <ert_tui_const.h>
 #include <enkf_tui_help.h>
 #include <enkf_tui_util.h>
+#include <enkf_tui_trace.h>
 #include <enkf_tui_fs.h>
+#include <enkf_tui_ranking.h>
+#include <enkf_tui_workflow.h>
+
+
+/**
+   Resource usage of one workflow job. The cpu times and the peak RSS
+   (kB) of an external job are taken from the rusage of its child
+   process, as returned by wait4(). An internal job runs in the thread
+   which calls it, and its cpu times are the RUSAGE_THREAD difference
+   over the job. The memory of an internal job can not be separated
+   from the rest of the process; its peak_rss is the high water mark of
+   the whole process when the job completes, and process_peak is set to
+   label it as such. A negative peak_rss means unknown.
+*/
+
+typedef struct {
+  double wall;
+  double cpu_user;
+  double cpu_sys;
+  long   peak_rss;
+  bool   process_peak;
+} enkf_tui_workflow_usage_type;
+
+
+static double enkf_tui_workflow_timeval_seconds( struct timeval tv ) {
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+
+static void enkf_tui_workflow_usage_reset( enkf_tui_workflow_usage_type * usage , bool process_peak ) {
+  usage->wall         = 0;
+  usage->cpu_user     = 0;
+  usage->cpu_sys      = 0;
+  usage->peak_rss     = -1;
+  usage->process_peak = process_peak;
+}
+
+
+/*
+  Without RUSAGE_THREAD the cpu times of an internal job are those of
+  the whole process, including any jobs running concurrently with it.
+*/
+
+static void enkf_tui_workflow_getrusage_thread( struct rusage * usage ) {
+#ifdef RUSAGE_THREAD
+  getrusage( RUSAGE_THREAD , usage );
+#else
+  getrusage( RUSAGE_SELF , usage );
+#endif
+}
+
+
+/**
+   Spawns an external job and waits for it; the job has failed unless
+   it exits with status zero. workflow_job_run() discards both the exit
+   status and the resource usage of the child, which is why external
+   jobs are not run through libres here.
+
+   The child may be forked from a multithreaded process, so between
+   fork() and execvp() it only calls async signal safe functions; the
+   error message is formatted before the fork.
+*/
+
+static bool enkf_tui_workflow_run_external( const workflow_job_type * job , const stringlist_type * args , enkf_tui_workflow_usage_type * usage ) {
+  const char * executable = workflow_job_get_executable( job );
+  const int argc = stringlist_get_size( args );
+  char ** argv = util_calloc( argc + 2 , sizeof * argv );
+  char * exec_error = util_alloc_sprintf("** Failed to execute %s \n" , executable );
+  size_t exec_error_len = strlen( exec_error );
+  struct rusage child_usage;
+  int status = -1;
+  pid_t pid;
+
+  argv[0] = (char *) executable;
+  for (int iarg = 0; iarg < argc; iarg++)
+    argv[iarg + 1] = (char *) stringlist_iget( args , iarg );
+  argv[argc + 1] = NULL;
+
+  pid = fork();
+  if (pid == 0) {
+    execvp( executable , argv );
+    if (write( STDERR_FILENO , exec_error , exec_error_len ) < 0) {
+      /* Nothing more can be done in the child. */
+    }
+    _exit( 127 );
+  }
+
+  if (pid < 0)
+    fprintf(stderr , "** Failed to fork %s: %s \n" , executable , strerror( errno ));
+  else {
+    while (wait4( pid , &status , 0 , &child_usage ) < 0) {
+      if (errno != EINTR) {
+        fprintf(stderr , "** Failed to wait for %s: %s \n" , executable , strerror( errno ));
+        status = -1;
+        break;
+      }
+    }
+  }
+  free( exec_error );
+  free( argv );
+
+  if (status >= 0) {
+    usage->cpu_user = enkf_tui_workflow_timeval_seconds( child_usage.ru_utime );
+    usage->cpu_sys  = enkf_tui_workflow_timeval_seconds( child_usage.ru_stime );
+    usage->peak_rss = child_usage.ru_maxrss;
+  }
+
+  if (status != 0) {
+    if (status > 0 && WIFSIGNALED( status ))
+      fprintf(stderr , "** Workflow job %s killed by signal %d \n" , workflow_job_get_name( job ) , WTERMSIG( status ));
+    else if (status > 0 && WIFEXITED( status ))
+      fprintf(stderr , "** Workflow job %s failed with exit status %d \n" , workflow_job_get_name( job ) , WEXITSTATUS( status ));
+  }
+  return (status == 0);
+}
+
+
+/**
+   Runs job number ijob of the workflow as a "workflow_job" trace span,
+   fills in usage and returns false if the job failed. Internal jobs
+   are run through workflow_job_run() exactly as libres does; they have
+   no failure status - workflow_job_run() only gives the return value
+   of the function - and are considered successful when they return.
+*/
+
+static bool enkf_tui_workflow_run_job( enkf_main_type * enkf_main , const workflow_type * workflow , int ijob , enkf_tui_workflow_usage_type * usage ) {
+  const workflow_job_type * job = workflow_iget_job( workflow , ijob );
+  const stringlist_type * args = workflow_iget_arguments( workflow , ijob );
+  const bool internal = workflow_job_internal( job );
+  enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "workflow_job" , workflow_job_get_name( job ) , -1 );
+  double start_time = enkf_tui_util_wallclock( );
+  bool OK = true;
+
+  enkf_tui_workflow_usage_reset( usage , internal );
+  if (internal) {
+    struct rusage start_usage , end_usage , process_usage;
+    void * return_value;
+
+    enkf_tui_workflow_getrusage_thread( &start_usage );
+    return_value = workflow_job_run( job , enkf_main , false , args );
+    enkf_tui_workflow_getrusage_thread( &end_usage );
+    util_safe_free( return_value );
+
+    getrusage( RUSAGE_SELF , &process_usage );
+    usage->cpu_user = enkf_tui_workflow_timeval_seconds( end_usage.ru_utime ) - enkf_tui_workflow_timeval_seconds( start_usage.ru_utime );
+    usage->cpu_sys  = enkf_tui_workflow_timeval_seconds( end_usage.ru_stime ) - enkf_tui_workflow_timeval_seconds( start_usage.ru_stime );
+    usage->peak_rss = process_usage.ru_maxrss;
+  } else
+    OK = enkf_tui_workflow_run_external( job , args , usage );
+
+  usage->wall = enkf_tui_util_wallclock( ) - start_time;
+  enkf_tui_trace_span_end( span );
+  return OK;
+}
+
+
+/**
+   Concurrent execution of the jobs in one workflow. By default the
+   jobs run one after another, exactly as with
+   ert_workflow_list_run_workflow_blocking(). Concurrency is opt in,
+   through annotations in trailing comments of the workflow file; the
+   workflow parser in libres ignores comments, so an annotated workflow
+   is still a valid workflow everywhere else:
+
+       EXPORT_RUNPATH  0-99              -- @name runpath
+       QC_PLOT         <RUNPATH_FILE>    -- @after runpath
+       QC_TABLE        <RUNPATH_FILE>    -- @after runpath
+       CSV_EXPORT      <RUNPATH_FILE>    -- @concurrent
+
+   @name gives the job a label, @after makes the job wait for the
+   labelled jobs (which must come earlier in the workflow) instead of
+   the job before it, and @concurrent makes the job independent of all
+   the other jobs. A job whose dependency failed is not started.
+
+   Internal jobs are functions which operate on the shared enkf_main
+   instance; by default an internal job is not started before all
+   running jobs have completed, and no other job is started while it
+   runs. An internal job annotated with @threadsafe is declared safe to
+   run concurrently with other jobs, and is scheduled like an external
+   job.
+
+   The annotations are matched with the compiled workflow line by line;
+   if the number of job lines in the file does not match the workflow,
+   or an annotation is invalid, a warning is printed and the workflow
+   is run sequentially.
+*/
+
+#define JOB_WAITING  0
+#define JOB_RUNNING  1
+#define JOB_DONE     2
+#define JOB_FAILED   3
+#define JOB_SKIPPED  4
+
+typedef struct {
+  int                 num_jobs;
+  bool                annotated;
+  int_vector_type  ** dependencies;
+  bool_vector_type  * threadsafe;
+} enkf_tui_workflow_schedule_type;
+
+
+typedef struct {
+  pthread_mutex_t   mutex;
+  pthread_cond_t    cond;
+  int_vector_type * complete;
+  int_vector_type * failed;
+} enkf_tui_workflow_queue_type;
+
+
+static void enkf_tui_workflow_schedule_set_sequential( enkf_tui_workflow_schedule_type * schedule ) {
+  for (int ijob = 0; ijob < schedule->num_jobs; ijob++) {
+    int_vector_reset( schedule->dependencies[ijob] );
+    if (ijob > 0)
+      int_vector_append( schedule->dependencies[ijob] , ijob - 1 );
+    bool_vector_iset( schedule->threadsafe , ijob , false );
+  }
+  schedule->annotated = false;
+}
+
+
+/*
+  Returns the text after the first "--" which is not inside quotes, or
+  NULL if the line has no comment.
+*/
+
+static const char * enkf_tui_workflow_line_comment( const char * line ) {
+  char quote = '\0';
+  for (const char * c = line; *c != '\0'; c++) {
+    if (quote != '\0') {
+      if (*c == quote)
+        quote = '\0';
+    } else if ((*c == '"') || (*c == '\''))
+      quote = *c;
+    else if ((c[0] == '-') && (c[1] == '-'))
+      return &c[2];
+  }
+  return NULL;
+}
+
+
+static bool enkf_tui_workflow_is_job_line( const char * line ) {
+  while (isspace( *line ))
+    line++;
+  return (*line != '\0') && (strncmp( line , "--" , 2 ) != 0);
+}
+
+
+/*
+  Applies the annotations in the comment of job ijob; labels maps the
+  @name labels of the earlier jobs to their index.
+*/
+
+static bool enkf_tui_workflow_parse_annotations( enkf_tui_workflow_schedule_type * schedule , int ijob , const char * comment , hash_type * labels , const char * src_file ) {
+  stringlist_type * tokens = stringlist_alloc_from_split( comment , " \t\r\n" );
+  bool has_after = false;
+  bool concurrent = false;
+  bool OK = true;
+
+  for (int itok = 0; OK && (itok < stringlist_get_size( tokens )); itok++) {
+    const char * token = stringlist_iget( tokens , itok );
+    const char * value = (itok + 1 < stringlist_get_size( tokens )) ? stringlist_iget( tokens , itok + 1 ) : NULL;
+
+    if (token[0] != '@')
+      continue;
+
+    if (strcmp( token , "@name" ) == 0) {
+      if ((value == NULL) || hash_has_key( labels , value )) {
+        fprintf(stderr , "** Warning: %s job %d: missing or duplicate @name label\n" , src_file , ijob );
+        OK = false;
+      } else {
+        hash_insert_int( labels , value , ijob );
+        itok++;
+      }
+    } else if (strcmp( token , "@after" ) == 0) {
+      if (value == NULL) {
+        fprintf(stderr , "** Warning: %s job %d: @after without labels\n" , src_file , ijob );
+        OK = false;
+      } else {
+        stringlist_type * after = stringlist_alloc_from_split( value , "," );
+        if (!has_after)
+          int_vector_reset( schedule->dependencies[ijob] );
+        for (int i = 0; i < stringlist_get_size( after ); i++) {
+          const char * label = stringlist_iget( after , i );
+          if (hash_has_key( labels , label ))
+            int_vector_append( schedule->dependencies[ijob] , hash_get_int( labels , label ));
+          else {
+            fprintf(stderr , "** Warning: %s job %d: @after %s - no earlier job has that @name\n" , src_file , ijob , label );
+            OK = false;
+          }
+        }
+        stringlist_free( after );
+        has_after = true;
+        itok++;
+      }
+    } else if (strcmp( token , "@concurrent" ) == 0) {
+      int_vector_reset( schedule->dependencies[ijob] );
+      concurrent = true;
+    } else if (strcmp( token , "@threadsafe" ) == 0)
+      bool_vector_iset( schedule->threadsafe , ijob , true );
+    else {
+      fprintf(stderr , "** Warning: %s job %d: unknown annotation %s\n" , src_file , ijob , token );
+      OK = false;
+    }
+    schedule->annotated = true;
+  }
+
+  if (has_after && concurrent) {
+    fprintf(stderr , "** Warning: %s job %d: both @after and @concurrent\n" , src_file , ijob );
+    OK = false;
+  }
+
+  stringlist_free( tokens );
+  return OK;
+}
+
+
+static bool enkf_tui_workflow_schedule_load( enkf_tui_workflow_schedule_type * schedule , const char * src_file ) {
+  FILE * stream = fopen( src_file , "r" );
+  hash_type * labels = hash_alloc();
+  int ijob = 0;
+  bool OK = true;
+
+  if (stream == NULL) {
+    fprintf(stderr , "** Warning: can not read %s: %s\n" , src_file , strerror( errno ));
+    OK = false;
+  } else {
+    bool at_eof = false;
+    while (!at_eof) {
+      char * line = util_fscanf_alloc_line( stream , &at_eof );
+      if (line != NULL) {
+        if (enkf_tui_workflow_is_job_line( line )) {
+          const char * comment = enkf_tui_workflow_line_comment( line );
+          if (OK && (comment != NULL) && (ijob < schedule->num_jobs))
+            OK = enkf_tui_workflow_parse_annotations( schedule , ijob , comment , labels , src_file );
+          ijob++;
+        }
+        free( line );
+      }
+    }
+    fclose( stream );
 
+    if (ijob != schedule->num_jobs) {
+      if (schedule->annotated)
+        fprintf(stderr , "** Warning: %s has %d job lines, the workflow has %d jobs\n" , src_file , ijob , schedule->num_jobs );
+      OK = false;
+    }
+  }
+
+  hash_free( labels );
+  return OK;
+}
+
+
+/*
+  The schedule of a compiled workflow; when the workflow file can not
+  be matched with the workflow the schedule is sequential.
+*/
+
+static enkf_tui_workflow_schedule_type * enkf_tui_workflow_schedule_alloc( const workflow_type * workflow ) {
+  enkf_tui_workflow_schedule_type * schedule = util_malloc( sizeof * schedule );
+  const char * src_file = workflow_get_src_file( workflow );
+
+  schedule->num_jobs     = workflow_size( workflow );
+  schedule->dependencies = util_calloc( schedule->num_jobs , sizeof * schedule->dependencies );
+  schedule->threadsafe   = bool_vector_alloc( schedule->num_jobs , false );
+  for (int ijob = 0; ijob < schedule->num_jobs; ijob++)
+    schedule->dependencies[ijob] = int_vector_alloc( 0 , 0 );
+
+  enkf_tui_workflow_schedule_set_sequential( schedule );
+  if (!enkf_tui_workflow_schedule_load( schedule , src_file )) {
+    if (schedule->annotated)
+      fprintf(stderr , "** Warning: ignoring the annotations in %s - the jobs run sequentially\n" , src_file );
+    enkf_tui_workflow_schedule_set_sequential( schedule );
+  }
+
+  return schedule;
+}
+
+
+static void enkf_tui_workflow_schedule_free( enkf_tui_workflow_schedule_type * schedule ) {
+  for (int ijob = 0; ijob < schedule->num_jobs; ijob++)
+    int_vector_free( schedule->dependencies[ijob] );
+  free( schedule->dependencies );
+  bool_vector_free( schedule->threadsafe );
+  free( schedule );
+}
+
+
+static void * enkf_tui_workflow_run_job_mt( void * arg ) {
+  arg_pack_type * arg_pack              = arg_pack_safe_cast( arg );
+  enkf_main_type * enkf_main            = arg_pack_iget_ptr( arg_pack , 0 );
+  workflow_type * workflow              = arg_pack_iget_ptr( arg_pack , 1 );
+  enkf_tui_workflow_queue_type * queue  = arg_pack_iget_ptr( arg_pack , 2 );
+  enkf_tui_workflow_usage_type * usage  = arg_pack_iget_ptr( arg_pack , 3 );
+  int ijob                              = arg_pack_iget_int( arg_pack , 4 );
+  bool OK = enkf_tui_workflow_run_job( enkf_main , workflow , ijob , usage );
+
+  pthread_mutex_lock( &queue->mutex );
+  int_vector_append( OK ? queue->complete : queue->failed , ijob );
+  pthread_cond_signal( &queue->cond );
+  pthread_mutex_unlock( &queue->mutex );
+  return NULL;
+}
+
+
+/*
+  Returns JOB_DONE if all the dependencies of the job are done,
+  JOB_SKIPPED if one of them failed or was skipped and JOB_WAITING
+  otherwise.
+*/
+
+static int enkf_tui_workflow_dependency_state( const int_vector_type * state , const int_vector_type * dependencies ) {
+  int dep_state = JOB_DONE;
+  for (int j = 0; j < int_vector_size( dependencies ); j++) {
+    int s = int_vector_iget( state , int_vector_iget( dependencies , j ));
+    if ((s == JOB_FAILED) || (s == JOB_SKIPPED))
+      return JOB_SKIPPED;
+    if (s != JOB_DONE)
+      dep_state = JOB_WAITING;
+  }
+  return dep_state;
+}
+
+
+/**
+   Runs the compiled workflow according to the schedule. On return
+   state holds JOB_DONE, JOB_FAILED or JOB_SKIPPED for every job, and
+   usage the resource usage of the jobs which have run. Progress is
+   printed on stdout when verbose is true. Returns false if any job
+   failed or was skipped.
+*/
+
+static bool enkf_tui_workflow_run_scheduled( enkf_main_type * enkf_main ,
+                                             workflow_type * workflow ,
+                                             const enkf_tui_workflow_schedule_type * schedule ,
+                                             int_vector_type * state ,
+                                             enkf_tui_workflow_usage_type * usage ,
+                                             bool verbose) {
+  const int num_jobs = schedule->num_jobs;
+  arg_pack_type ** arg_list = util_calloc( num_jobs , sizeof * arg_list );
+  thread_pool_type * tp = thread_pool_alloc( enkf_tui_util_get_num_threads() , true );
+  int num_complete = 0;
+  int num_running  = 0;
+  bool exclusive   = false;
+  bool OK = true;
+  enkf_tui_workflow_queue_type queue;
+
+  pthread_mutex_init( &queue.mutex , NULL );
+  pthread_cond_init( &queue.cond , NULL );
+  queue.complete = int_vector_alloc( 0 , 0 );
+  queue.failed   = int_vector_alloc( 0 , 0 );
+
+  int_vector_reset( state );
+  for (int ijob = 0; ijob < num_jobs; ijob++) {
+    int_vector_iset( state , ijob , JOB_WAITING );
+    enkf_tui_workflow_usage_reset( &usage[ijob] , false );
+
+    arg_list[ijob] = arg_pack_alloc();
+    arg_pack_append_ptr( arg_list[ijob] , enkf_main );
+    arg_pack_append_ptr( arg_list[ijob] , workflow );
+    arg_pack_append_ptr( arg_list[ijob] , &queue );
+    arg_pack_append_ptr( arg_list[ijob] , &usage[ijob] );
+    arg_pack_append_int( arg_list[ijob] , ijob );
+  }
+
+  while (num_complete < num_jobs) {
+    /* Skipping a job can make an earlier job skippable, hence the repeated scan. */
+    bool skipped;
+    do {
+      skipped = false;
+      for (int ijob = 0; (ijob < num_jobs) && !exclusive; ijob++) {
+        if (int_vector_iget( state , ijob ) == JOB_WAITING) {
+          const workflow_job_type * job = workflow_iget_job( workflow , ijob );
+          int dep_state = enkf_tui_workflow_dependency_state( state , schedule->dependencies[ijob] );
+
+          if (dep_state == JOB_SKIPPED) {
+            if (verbose)
+              printf("Skipping job %d: %s - a dependency failed \n" , ijob , workflow_job_get_name( job ));
+            int_vector_iset( state , ijob , JOB_SKIPPED );
+            num_complete++;
+            OK = false;
+            skipped = true;
+          } else if (dep_state == JOB_DONE) {
+            bool job_exclusive = workflow_job_internal( job ) && !bool_vector_iget( schedule->threadsafe , ijob );
+            if (!job_exclusive || (num_running == 0)) {
+              if (verbose)
+                printf("Starting job %d: %s \n" , ijob , workflow_job_get_name( job ));
+              int_vector_iset( state , ijob , JOB_RUNNING );
+              thread_pool_add_job( tp , enkf_tui_workflow_run_job_mt , arg_list[ijob] );
+              num_running++;
+              exclusive = job_exclusive;
+            }
+          }
+        }
+      }
+    } while (skipped);
+
+    /* The dependencies always point backwards, so some job can always be started. */
+    if (num_running == 0) {
+      if (num_complete < num_jobs)
+        util_abort("%s: internal error - no job to start\n",__func__);
+      break;
+    }
+
+    pthread_mutex_lock( &queue.mutex );
+    while ((int_vector_size( queue.complete ) + int_vector_size( queue.failed )) == 0)
+      pthread_cond_wait( &queue.cond , &queue.mutex );
+
+    for (int i = 0; i < int_vector_size( queue.complete ); i++) {
+      int ijob = int_vector_iget( queue.complete , i );
+      if (verbose)
+        printf("Completed job %d: %s \n" , ijob , workflow_job_get_name( workflow_iget_job( workflow , ijob )));
+      int_vector_iset( state , ijob , JOB_DONE );
+    }
+
+    for (int i = 0; i < int_vector_size( queue.failed ); i++) {
+      int ijob = int_vector_iget( queue.failed , i );
+      if (verbose)
+        printf("Failed job %d: %s \n" , ijob , workflow_job_get_name( workflow_iget_job( workflow , ijob )));
+      int_vector_iset( state , ijob , JOB_FAILED );
+      OK = false;
+    }
+
+    num_complete += int_vector_size( queue.complete ) + int_vector_size( queue.failed );
+    num_running  -= int_vector_size( queue.complete ) + int_vector_size( queue.failed );
+    if (num_running == 0)
+      exclusive = false;
+
+    int_vector_reset( queue.complete );
+    int_vector_reset( queue.failed );
+    pthread_mutex_unlock( &queue.mutex );
+  }
+  thread_pool_join( tp );
+
+  for (int ijob = 0; ijob < num_jobs; ijob++)
+    arg_pack_free( arg_list[ijob] );
+  free( arg_list );
+  int_vector_free( queue.complete );
+  int_vector_free( queue.failed );
+  pthread_cond_destroy( &queue.cond );
+  pthread_mutex_destroy( &queue.mutex );
+  thread_pool_free( tp );
+  return OK;
+}
+
+
+static const char * enkf_tui_workflow_job_status( int job_state ) {
+  switch (job_state) {
+  case JOB_DONE:
+    return "ok";
+  case JOB_FAILED:
+    return "failed";
+  default:
+    return "skipped";
+  }
+}
+
+#undef JOB_WAITING
+#undef JOB_RUNNING
+#undef JOB_DONE
+#undef JOB_FAILED
+#undef JOB_SKIPPED
+
+
+/**
+   Runs a workflow from the menu. A workflow without annotations is run
+   by libres, exactly as before; an annotated workflow is run by the
+   scheduler above.
+*/
 
 void enkf_tui_workflow_run( void * arg ) {
   enkf_main_type * enkf_main = enkf_main_safe_cast( arg );
@@ -52,11 +634,36 @@ void enkf_tui_workflow_run( void * arg ) {
       char * workflow_name = util_alloc_stdin_line();
       if (workflow_name != NULL) {
         if (ert_workflow_list_has_workflow( workflow_list , workflow_name )) {
-          bool runOK = ert_workflow_list_run_workflow_blocking( workflow_list , workflow_name , enkf_main);
-          if (!runOK) {
+          workflow_type * workflow = ert_workflow_list_get_workflow( workflow_list , workflow_name );
+          if (workflow_try_compile( workflow , ert_workflow_list_get_context( workflow_list ))) {
+            enkf_tui_workflow_schedule_type * schedule = enkf_tui_workflow_schedule_alloc( workflow );
+            bool runOK;
+
+            if (schedule->annotated) {
+              int_vector_type * state = int_vector_alloc( 0 , 0 );
+              enkf_tui_workflow_usage_type * usage = util_calloc( schedule->num_jobs , sizeof * usage );
+
+              runOK = enkf_tui_workflow_run_scheduled( enkf_main , workflow , schedule , state , usage , true );
+              if (!runOK)
+                printf("Errors in workflow:%s \n", workflow_name );
+
+              free( usage );
+              int_vector_free( state );
+            } else {
+              runOK = ert_workflow_list_run_workflow_blocking( workflow_list , workflow_name , enkf_main);
+              if (!runOK) {
+                printf("Errors in workflow:%s \n", workflow_name );
+                printf("-----------------------------------------------------------------\n");
+                config_error_fprintf( ert_workflow_list_get_last_error( workflow_list ) , true , stdout);
+                printf("-----------------------------------------------------------------\n");
+              }
+            }
+            enkf_tui_ranking_invalidate_snapshots( );
+            enkf_tui_workflow_schedule_free( schedule );
+          } else {
             printf("Errors in workflow:%s \n", workflow_name );
             printf("-----------------------------------------------------------------\n");
-            config_error_fprintf( ert_workflow_list_get_last_error( workflow_list ) , true , stdout);
+            config_error_fprintf( workflow_get_last_error( workflow ) , true , stdout);
             printf("-----------------------------------------------------------------\n");
           }
         }
@@ -67,6 +674,122 @@ void enkf_tui_workflow_run( void * arg ) {
 }
 
 
+/*
+  Resource usage of the process, including the child processes of
+  external workflow jobs, since it started; the workflow record is the
+  difference between two samples.
+*/
+
+static void enkf_tui_workflow_usage_sample( enkf_tui_workflow_usage_type * usage ) {
+  struct rusage self_usage;
+  struct rusage child_usage;
+
+  getrusage( RUSAGE_SELF , &self_usage );
+  getrusage( RUSAGE_CHILDREN , &child_usage );
+
+  usage->wall         = enkf_tui_util_wallclock();
+  usage->cpu_user     = enkf_tui_workflow_timeval_seconds( self_usage.ru_utime ) + enkf_tui_workflow_timeval_seconds( child_usage.ru_utime );
+  usage->cpu_sys      = enkf_tui_workflow_timeval_seconds( self_usage.ru_stime ) + enkf_tui_workflow_timeval_seconds( child_usage.ru_stime );
+  usage->peak_rss     = (self_usage.ru_maxrss > child_usage.ru_maxrss) ? self_usage.ru_maxrss : child_usage.ru_maxrss;
+  usage->process_peak = true;
+}
+
+
+/**
+   Writes one JSON object on one line; job_name == NULL is used for
+   the record of the complete workflow. The peak RSS is written as
+   peak_rss_kb when it belongs to the job alone and as
+   process_peak_rss_kb when it is the high water mark of the whole
+   process; a negative peak_rss is written as null.
+*/
+
+static void enkf_tui_workflow_fprintf_usage( FILE * stream ,
+                                             const char * workflow_name ,
+                                             const char * job_name ,
+                                             int job_index ,
+                                             const char * status ,
+                                             const enkf_tui_workflow_usage_type * usage) {
+  fprintf( stream , "{\"record\": \"%s\", \"workflow\": " , (job_name == NULL) ? "workflow" : "job");
+  enkf_tui_util_fprintf_json_string( stream , workflow_name );
+  if (job_name != NULL) {
+    fprintf( stream , ", \"job\": " );
+    enkf_tui_util_fprintf_json_string( stream , job_name );
+    fprintf( stream , ", \"index\": %d" , job_index );
+  }
+  fprintf( stream , ", \"status\": \"%s\", \"wall_s\": %.6f, \"cpu_user_s\": %.6f, \"cpu_sys_s\": %.6f" ,
+           status ,
+           usage->wall ,
+           usage->cpu_user ,
+           usage->cpu_sys );
+
+  fprintf( stream , ", \"%s\": " , usage->process_peak ? "process_peak_rss_kb" : "peak_rss_kb");
+  if (usage->peak_rss >= 0)
+    fprintf( stream , "%ld}\n" , usage->peak_rss );
+  else
+    fprintf( stream , "null}\n" );
+  fflush( stream );
+}
+
+
+/**
+   Runs the workflow with the same scheduler as the menu, i.e.
+   sequentially unless the workflow file is annotated, and writes one
+   report record per job, in workflow order, and one for the whole
+   workflow to report_stream. A failed job does not stop the workflow,
+   but the job is reported as "failed", its dependents as "skipped" and
+   the workflow as "failed". Returns false if the workflow does not
+   exist, does not compile or if any of the jobs failed.
+*/
+
+bool enkf_tui_workflow_run_batch( enkf_main_type * enkf_main , const char * workflow_name , FILE * report_stream ) {
+  ert_workflow_list_type * workflow_list = enkf_main_get_workflow_list( enkf_main );
+  enkf_tui_workflow_usage_type workflow_start , workflow_end , workflow_usage;
+  const char * status = "ok";
+
+  enkf_tui_workflow_usage_sample( &workflow_start );
+  if (!ert_workflow_list_has_workflow( workflow_list , workflow_name )) {
+    fprintf(stderr , "** No such workflow: %s \n" , workflow_name );
+    status = "unknown";
+  } else {
+    workflow_type * workflow = ert_workflow_list_get_workflow( workflow_list , workflow_name );
+    if (workflow_try_compile( workflow , ert_workflow_list_get_context( workflow_list ))) {
+      enkf_tui_workflow_schedule_type * schedule = enkf_tui_workflow_schedule_alloc( workflow );
+      int_vector_type * state = int_vector_alloc( 0 , 0 );
+      enkf_tui_workflow_usage_type * usage = util_calloc( schedule->num_jobs , sizeof * usage );
+
+      if (!enkf_tui_workflow_run_scheduled( enkf_main , workflow , schedule , state , usage , false ))
+        status = "failed";
+
+      for (int ijob = 0; ijob < schedule->num_jobs; ijob++) {
+        const workflow_job_type * job = workflow_iget_job( workflow , ijob );
+        enkf_tui_workflow_fprintf_usage( report_stream , workflow_name , workflow_job_get_name( job ) , ijob ,
+                                         enkf_tui_workflow_job_status( int_vector_iget( state , ijob )) , &usage[ijob] );
+      }
+
+      free( usage );
+      int_vector_free( state );
+      enkf_tui_workflow_schedule_free( schedule );
+      enkf_tui_ranking_invalidate_snapshots( );
+    } else {
+      fprintf(stderr , "Errors in workflow:%s \n", workflow_name );
+      fprintf(stderr , "-----------------------------------------------------------------\n");
+      config_error_fprintf( workflow_get_last_error( workflow ) , true , stderr);
+      fprintf(stderr , "-----------------------------------------------------------------\n");
+      status = "compile_error";
+    }
+  }
+  enkf_tui_workflow_usage_sample( &workflow_end );
+
+  workflow_usage = workflow_end;
+  workflow_usage.wall     -= workflow_start.wall;
+  workflow_usage.cpu_user -= workflow_start.cpu_user;
+  workflow_usage.cpu_sys  -= workflow_start.cpu_sys;
+  enkf_tui_workflow_fprintf_usage( report_stream , workflow_name , NULL , 0 , status , &workflow_usage );
+
+  return (strcmp( status , "ok" ) == 0);
+}
+
+
 void enkf_tui_workflow_load( void * arg ) {
   // ...
 }
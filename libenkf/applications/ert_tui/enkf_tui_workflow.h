@@ -19,6 +19,12 @@
 #ifndef  ERT_ENKF_TUI_WORKFLOW_H
 #define  ERT_ENKF_TUI_WORKFLOW_H
 
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <ert/enkf/enkf_main.h>
+
 void enkf_tui_workflow_menu(void *);
+bool enkf_tui_workflow_run_batch( enkf_main_type * enkf_main , const char * workflow_name , FILE * report_stream );
 
 #endif
@@ -0,0 +1,397 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'fs_migration.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <ert/util/util.h>
+#include <ert/util/hash.h>
+#include <ert/util/vector.h>
+#include <ert/util/stringlist.h>
+#include <ert/util/arg_pack.h>
+#include <ert/util/thread_pool.h>
+#include <ert/util/block_fs.h>
+#include <ert/util/msg.h>
+
+#include <ert/enkf/fs_types.h>
+
+#include <fs_migration.h>
+
+
+/**
+   Engine for resumable migrations of the storage below ENSPATH.
+
+   A migration is a list of named steps, each belonging to one case
+   and one phase. The steps of one phase run concurrently on a thread
+   pool; a phase is started when all the steps of the previous phase
+   have completed. Every completed step is appended to the journal
+   file of its case
+
+       <enspath>/<case>/<journal_name>
+
+   and flushed to disk before the step is counted as complete. A step
+   which returns false is not journalled, and the migration stops
+   after the phase of the failed step. When an interrupted or failed
+   migration is restarted the steps found in the journals are
+   skipped, i.e. the steps must be written so that they can be
+   repeated after an interruption at any point.
+
+   The enkf_mount_info file should only be rewritten with the new
+   version by fs_migration_commit(), when all the steps of all the
+   cases have completed; an interrupted ENSPATH then still identifies
+   itself with the old version.
+*/
+
+
+typedef struct {
+  pthread_mutex_t   lock;
+  char            * filename;
+  FILE            * stream;
+  hash_type       * complete_steps;
+} fs_migration_journal_type;
+
+
+typedef struct {
+  fs_migration_type         * migration;
+  fs_migration_journal_type * journal;
+  int                         phase;
+  char                      * name;
+  fs_migration_step_ftype   * func;
+  arg_pack_type             * arg;
+} fs_migration_step_type;
+
+
+typedef struct {
+  pthread_mutex_t   lock;
+  msg_type        * msg;
+  int               complete_count;
+  int               failed_count;
+  int               total_count;
+} fs_migration_progress_type;
+
+
+struct fs_migration_struct {
+  int                          num_cases;
+  fs_migration_journal_type ** journals;
+  stringlist_type            * phases;
+  vector_type                * steps;
+  fs_migration_progress_type * progress;
+};
+
+
+
+static fs_migration_journal_type * fs_migration_journal_alloc( const char * enspath , const char * case_path , const char * journal_name ) {
+  fs_migration_journal_type * journal = util_malloc( sizeof * journal );
+  journal->filename       = util_alloc_sprintf("%s/%s/%s" , enspath , case_path , journal_name );
+  journal->complete_steps = hash_alloc();
+  pthread_mutex_init( &journal->lock , NULL );
+
+  if (util_file_exists( journal->filename )) {
+    FILE * stream = util_fopen( journal->filename , "r");
+    bool at_eof = false;
+    while (!at_eof) {
+      char * step = util_fscanf_alloc_line( stream , &at_eof );
+      if (step != NULL) {
+        if (strlen( step ) > 0)
+          hash_insert_int( journal->complete_steps , step , 1 );
+        free( step );
+      }
+    }
+    fclose( stream );
+  }
+
+  journal->stream = util_fopen( journal->filename , "a");
+  return journal;
+}
+
+
+static bool fs_migration_journal_has_step( fs_migration_journal_type * journal , const char * step ) {
+  bool has_step;
+  pthread_mutex_lock( &journal->lock );
+  has_step = hash_has_key( journal->complete_steps , step );
+  pthread_mutex_unlock( &journal->lock );
+  return has_step;
+}
+
+
+static void fs_migration_journal_add_step( fs_migration_journal_type * journal , const char * step ) {
+  pthread_mutex_lock( &journal->lock );
+  {
+    fprintf( journal->stream , "%s\n" , step );
+    fflush( journal->stream );
+    fsync( fileno( journal->stream ));
+    hash_insert_int( journal->complete_steps , step , 1 );
+  }
+  pthread_mutex_unlock( &journal->lock );
+}
+
+
+static void fs_migration_journal_free( fs_migration_journal_type * journal , bool unlink_file) {
+  fclose( journal->stream );
+  if (unlink_file)
+    util_unlink_existing( journal->filename );
+
+  pthread_mutex_destroy( &journal->lock );
+  hash_free( journal->complete_steps );
+  free( journal->filename );
+  free( journal );
+}
+
+
+/*****************************************************************/
+
+
+static fs_migration_progress_type * fs_migration_progress_alloc( const char * prefix , int total_count ) {
+  fs_migration_progress_type * progress = util_malloc( sizeof * progress );
+  pthread_mutex_init( &progress->lock , NULL );
+  progress->msg            = msg_alloc( prefix , false );
+  progress->complete_count = 0;
+  progress->failed_count   = 0;
+  progress->total_count    = total_count;
+  msg_show( progress->msg );
+  return progress;
+}
+
+
+static void fs_migration_progress_step( fs_migration_progress_type * progress , bool ok ) {
+  pthread_mutex_lock( &progress->lock );
+  {
+    char * text;
+    if (ok)
+      progress->complete_count++;
+    else
+      progress->failed_count++;
+
+    if (progress->failed_count > 0)
+      text = util_alloc_sprintf("%d/%d steps (%d failed)" , progress->complete_count , progress->total_count , progress->failed_count );
+    else
+      text = util_alloc_sprintf("%d/%d steps" , progress->complete_count , progress->total_count );
+    msg_update( progress->msg , text );
+    free( text );
+  }
+  pthread_mutex_unlock( &progress->lock );
+}
+
+
+static void fs_migration_progress_free( fs_migration_progress_type * progress ) {
+  msg_free( progress->msg , false );
+  pthread_mutex_destroy( &progress->lock );
+  free( progress );
+}
+
+
+/*****************************************************************/
+
+
+static void fs_migration_step_free__( void * arg ) {
+  fs_migration_step_type * step = arg;
+  arg_pack_free( step->arg );
+  free( step->name );
+  free( step );
+}
+
+
+fs_migration_type * fs_migration_alloc( const char * enspath , const stringlist_type * case_list , const char * journal_name ) {
+  fs_migration_type * migration = util_malloc( sizeof * migration );
+  migration->num_cases = stringlist_get_size( case_list );
+  migration->journals  = util_calloc( migration->num_cases , sizeof * migration->journals );
+  migration->phases    = stringlist_alloc_new( );
+  migration->steps     = vector_alloc_new( );
+  migration->progress  = NULL;
+
+  for (int ic = 0; ic < migration->num_cases; ic++)
+    migration->journals[ic] = fs_migration_journal_alloc( enspath , stringlist_iget( case_list , ic ) , journal_name );
+
+  return migration;
+}
+
+
+void fs_migration_free( fs_migration_type * migration ) {
+  for (int ic = 0; ic < migration->num_cases; ic++) {
+    if (migration->journals[ic] != NULL)
+      fs_migration_journal_free( migration->journals[ic] , false );
+  }
+  free( migration->journals );
+  vector_free( migration->steps );
+  stringlist_free( migration->phases );
+  free( migration );
+}
+
+
+/**
+   Returns the number of the new phase; the label is used as prefix
+   for the progress messages of the phase.
+*/
+
+int fs_migration_add_phase( fs_migration_type * migration , const char * label ) {
+  stringlist_append_copy( migration->phases , label );
+  return stringlist_get_size( migration->phases ) - 1;
+}
+
+
+/**
+   Adds the step 'step_name' of case 'case_nr'; the migration takes
+   ownership of the arg_pack, which is passed to func when the step
+   is run. The step names must be unique within a case.
+*/
+
+void fs_migration_add_step( fs_migration_type * migration , int phase , int case_nr , const char * step_name , fs_migration_step_ftype * func , arg_pack_type * arg ) {
+  fs_migration_step_type * step = util_malloc( sizeof * step );
+
+  if ((phase < 0) || (phase >= stringlist_get_size( migration->phases )))
+    util_abort("%s: invalid phase:%d \n",__func__ , phase );
+
+  step->migration = migration;
+  step->journal   = migration->journals[case_nr];
+  step->phase     = phase;
+  step->name      = util_alloc_string_copy( step_name );
+  step->func      = func;
+  step->arg       = arg;
+  vector_append_owned_ref( migration->steps , step , fs_migration_step_free__ );
+}
+
+
+/**
+   A migration which unlinks entries leaves the unlinked entries as
+   free space in the block_fs data files. Mounting a block_fs with
+   fragmentation limit zero should make block_fs rotate the data
+   file, i.e. copy the live entries to a new data file, whenever
+   there is any free space. Since that happens (or not) inside
+   block_fs_mount() the result is verified: the file is mounted again
+   read-only, and the step fails, and is not journalled, if there are
+   still free nodes left.
+*/
+
+static int fs_migration_count_free_nodes( block_fs_type * fs ) {
+  vector_type * all_nodes  = block_fs_alloc_filelist( fs , NULL , NO_SORT , true );
+  vector_type * live_nodes = block_fs_alloc_filelist( fs , NULL , NO_SORT , false );
+  int free_nodes = vector_get_size( all_nodes ) - vector_get_size( live_nodes );
+
+  vector_free( live_nodes );
+  vector_free( all_nodes );
+  return free_nodes;
+}
+
+
+static bool fs_migration_compact_block_fs( const arg_pack_type * arg ) {
+  const char * mount_file = arg_pack_iget_const_ptr( arg , 0 );
+  int free_nodes = 0;
+
+  {
+    block_fs_type * fs = block_fs_mount( mount_file , 32 , 0 , 0 , 1 , false , false , true );
+    block_fs_close( fs , true );
+  }
+
+  /* An empty block_fs is removed by block_fs_close(). */
+  if (util_file_exists( mount_file )) {
+    block_fs_type * fs = block_fs_mount( mount_file , 1 , 0 , 1 , 0 , false , true , false );
+    free_nodes = fs_migration_count_free_nodes( fs );
+    block_fs_close( fs , false );
+  }
+
+  if (free_nodes > 0) {
+    fprintf(stderr , "** Compaction of %s left %d free nodes in the data file.\n" , mount_file , free_nodes );
+    return false;
+  } else
+    return true;
+}
+
+
+void fs_migration_add_compaction( fs_migration_type * migration , int phase , int case_nr , const char * mount_file ) {
+  arg_pack_type * arg = arg_pack_alloc( );
+  char * step_name = util_alloc_sprintf( "COMPACT %s" , mount_file );
+
+  arg_pack_append_owned_ptr( arg , util_alloc_string_copy( mount_file ) , free );
+  fs_migration_add_step( migration , phase , case_nr , step_name , fs_migration_compact_block_fs , arg );
+  free( step_name );
+}
+
+
+static void * fs_migration_step_mt( void * arg ) {
+  fs_migration_step_type * step = arg;
+  bool ok = true;
+
+  if (!fs_migration_journal_has_step( step->journal , step->name )) {
+    ok = step->func( step->arg );
+    if (ok)
+      fs_migration_journal_add_step( step->journal , step->name );
+  }
+
+  fs_migration_progress_step( step->migration->progress , ok );
+  return NULL;
+}
+
+
+/**
+   Runs the phases in order. Returns false, without starting the
+   following phases, if any step of a phase failed.
+*/
+
+bool fs_migration_run( fs_migration_type * migration , int num_threads ) {
+  bool ok = true;
+  for (int phase = 0; ok && (phase < stringlist_get_size( migration->phases )); phase++) {
+    thread_pool_type * tp = thread_pool_alloc( num_threads , true );
+    int num_steps = 0;
+
+    for (int i = 0; i < vector_get_size( migration->steps ); i++) {
+      const fs_migration_step_type * step = vector_iget_const( migration->steps , i );
+      if (step->phase == phase)
+        num_steps++;
+    }
+
+    migration->progress = fs_migration_progress_alloc( stringlist_iget( migration->phases , phase ) , num_steps );
+    for (int i = 0; i < vector_get_size( migration->steps ); i++) {
+      fs_migration_step_type * step = vector_iget( migration->steps , i );
+      if (step->phase == phase)
+        thread_pool_add_job( tp , fs_migration_step_mt , step );
+    }
+    thread_pool_join( tp );
+    thread_pool_free( tp );
+
+    ok = (migration->progress->failed_count == 0);
+    fs_migration_progress_free( migration->progress );
+    migration->progress = NULL;
+  }
+  return ok;
+}
+
+
+/**
+   Rewrites the enkf_mount_info file with the new version, and then
+   removes the journals. Should only be called when fs_migration_run()
+   has completed.
+*/
+
+void fs_migration_commit( fs_migration_type * migration , const char * mount_info_file , int version ) {
+  {
+    FILE * stream = util_fopen( mount_info_file , "w");
+    util_fwrite_long( FS_MAGIC_ID , stream );
+    util_fwrite_int( version , stream );
+    fflush( stream );
+    fsync( fileno( stream ));
+    fclose( stream );
+  }
+
+  for (int ic = 0; ic < migration->num_cases; ic++) {
+    fs_migration_journal_free( migration->journals[ic] , true );
+    migration->journals[ic] = NULL;
+  }
+}
@@ -0,0 +1,39 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'fs_migration.h' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#ifndef ERT_FS_MIGRATION_H
+#define ERT_FS_MIGRATION_H
+
+#include <stdbool.h>
+
+#include <ert/util/stringlist.h>
+#include <ert/util/arg_pack.h>
+
+typedef struct fs_migration_struct fs_migration_type;
+
+typedef bool (fs_migration_step_ftype) (const arg_pack_type * arg);
+
+fs_migration_type * fs_migration_alloc( const char * enspath , const stringlist_type * case_list , const char * journal_name );
+void                fs_migration_free( fs_migration_type * migration );
+int                 fs_migration_add_phase( fs_migration_type * migration , const char * label );
+void                fs_migration_add_step( fs_migration_type * migration , int phase , int case_nr , const char * step_name , fs_migration_step_ftype * func , arg_pack_type * arg );
+void                fs_migration_add_compaction( fs_migration_type * migration , int phase , int case_nr , const char * mount_file );
+bool                fs_migration_run( fs_migration_type * migration , int num_threads );
+void                fs_migration_commit( fs_migration_type * migration , const char * mount_info_file , int version );
+
+#endif
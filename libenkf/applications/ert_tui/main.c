@@ -25,16 +25,30 @@
 #include <ert/util/util.h>
 #include <ert/util/hash.h>
 #include <ert/util/stringlist.h>
+#include <ert/util/double_vector.h>
 
 #include <ert/enkf/enkf_fs.h>
 #include <ert/enkf/site_config.h>
 #include <ert/enkf/enkf_main.h>
 #include <ert/enkf/enkf_types.h>
 #include <enkf_tui_main.h>
+#include <enkf_tui_util.h>
+#include <enkf_tui_workflow.h>
+#include <enkf_tui_trace.h>
 
 #define WORKFLOW_OPTION "-wf"
+#define TIMING_OPTION   "--timing"
+#define BATCH_OPTION    "--batch"
+#define REPORT_OPTION   "--report="
+#define TRACE_OPTION    "--trace="
 
-void text_splash() {
+/**
+   The splash is only animated when ert_tui is used interactively;
+   when running workflows from the commandline, or with stdout
+   redirected, it is printed without delays.
+*/
+
+void text_splash( bool animate ) {
   const int usleep_time = 1000;
   int i;
   {
@@ -42,11 +56,13 @@ void text_splash() {
     printf("\n\n");
     for (i = 0; i < SPLASH_LENGTH; i++) {
       printf("%s\n" , splash_text[i]);
-      util_usleep(usleep_time);
+      if (animate)
+        util_usleep(usleep_time);
     }
     printf("\n\n");
 
-    sleep(1);
+    if (animate)
+      sleep(1);
 #undef SPLASH_LENGTH
   }
 }
@@ -109,9 +125,17 @@ static void init_debug( const char * argv0) {
 
 
 
+/**
+   All arguments after the config file are workflows, except the
+   options starting with "--".
+*/
+
 void parse_workflows(int argc , char ** argv , stringlist_type * workflows) {
   /* bool workflow_on = false; */
   for (int iarg = 2; iarg < argc; iarg++) {
+    if (strncmp( argv[iarg] , "--" , 2 ) == 0)
+      continue;
+
     stringlist_append_copy( workflows , argv[iarg]);
     
     /*if (strcmp( argv[iarg] , WORKFLOW_OPTION) == 0)
@@ -127,10 +151,102 @@ void parse_workflows(int argc , char ** argv , stringlist_type * workflows) {
 }
 
 
+static int num_workflow_args(int argc , char ** argv) {
+  int num_workflows = 0;
+  for (int iarg = 2; iarg < argc; iarg++)
+    if (strncmp( argv[iarg] , "--" , 2 ) != 0)
+      num_workflows++;
+  return num_workflows;
+}
+
+
+static bool has_option(int argc , char ** argv , const char * option) {
+  for (int iarg = 2; iarg < argc; iarg++)
+    if (strcmp( argv[iarg] , option ) == 0)
+      return true;
+  return false;
+}
+
+
+/**
+   Returns the value of an option given as --option=value, or NULL if
+   the option is not present.
+*/
+
+static const char * get_option_value(int argc , char ** argv , const char * option_prefix) {
+  for (int iarg = 2; iarg < argc; iarg++)
+    if (strncmp( argv[iarg] , option_prefix , strlen( option_prefix )) == 0)
+      return &argv[iarg][ strlen( option_prefix ) ];
+  return NULL;
+}
+
+
+/**
+   In batch mode the workflows given on the commandline are run
+   without entering the menu; a JSON record with wall time, cpu time
+   and peak RSS is written for each workflow job and each workflow to
+   the file given with --report=file, or to stdout. The exit status
+   is zero if all the workflows ran without failing jobs, and one
+   otherwise.
+*/
+
+static int run_batch( enkf_main_type * enkf_main , const stringlist_type * workflow_list , const char * report_file) {
+  FILE * report_stream = stdout;
+  int status = 0;
+
+  if (report_file != NULL)
+    report_stream = util_mkdir_fopen( report_file , "w");
+
+  for (int iwf = 0; iwf < stringlist_get_size( workflow_list ); iwf++) {
+    if (!enkf_tui_workflow_run_batch( enkf_main , stringlist_iget( workflow_list , iwf ) , report_stream ))
+      status = 1;
+  }
+
+  if (report_stream != stdout)
+    fclose( report_stream );
+  return status;
+}
+
+
+static void startup_timing_add( stringlist_type * labels , double_vector_type * times , const char * label , double * t0) {
+  double t1 = enkf_tui_util_wallclock();
+  stringlist_append_copy( labels , label );
+  double_vector_append( times , t1 - *t0 );
+  *t0 = t1;
+}
+
+
+static void startup_timing_fprintf( const stringlist_type * labels , const double_vector_type * times , FILE * stream) {
+  double total = 0;
+  fprintf(stream , "\nStartup timing:\n");
+  for (int i = 0; i < stringlist_get_size( labels ); i++) {
+    fprintf(stream , "  %-30s %8.3f s\n" , stringlist_iget( labels , i ) , double_vector_iget( times , i ));
+    total += double_vector_iget( times , i );
+  }
+  fprintf(stream , "  %-30s %8.3f s\n\n" , "total" , total );
+}
+
+
 
 
 int main (int argc , char ** argv) {
-  text_splash();
+  bool timing = has_option( argc , argv , TIMING_OPTION );
+  bool batch  = has_option( argc , argv , BATCH_OPTION );
+  int exit_status = 0;
+  stringlist_type * timing_labels = stringlist_alloc_new();
+  double_vector_type * timing_values = double_vector_alloc( 0 , 0 );
+  double t0 = enkf_tui_util_wallclock();
+
+  {
+    const char * trace_file = get_option_value( argc , argv , TRACE_OPTION );
+    if (trace_file == NULL)
+      trace_file = getenv( ENKF_TUI_TRACE_ENV );
+    if ((trace_file != NULL) && (strlen( trace_file ) > 0))
+      enkf_tui_trace_init( trace_file );
+  }
+
+  if (!batch)
+    text_splash( (num_workflow_args( argc , argv ) == 0) && isatty( STDOUT_FILENO ) );
   init_debug( argv[0] );
   printf("\n");
   printf("Documentation : %s \n","http://ert.nr.no");
@@ -151,19 +267,35 @@ int main (int argc , char ** argv) {
     if ( !(util_entry_readable(model_config_file) && util_is_file(model_config_file)) )
       util_exit("Can not read file %s - exiting \n", model_config_file);
 
+    if (batch && (stringlist_get_size( workflow_list ) == 0))
+      util_exit("The %s option requires at least one workflow - exiting \n", BATCH_OPTION);
+
     {
       char * abs_config = util_alloc_realpath( model_config_file );
       printf("model config  : %s \n\n", abs_config);
       free(abs_config);
     }
     enkf_welcome( model_config_file );
+    startup_timing_add( timing_labels , timing_values , "splash/arguments" , &t0 );
     {
       site_config_type * site_config = site_config_alloc_load_user_config(
                                                             model_config_file
                                                             );
+      startup_timing_add( timing_labels , timing_values , "site config" , &t0 );
+      enkf_tui_trace_span_type * span = enkf_tui_trace_span_begin( "enkf_main_alloc" , model_config_file , -1 );
       enkf_main_type * enkf_main = enkf_main_alloc(model_config_file, site_config, true, true);
-      enkf_main_run_workflows( enkf_main , workflow_list );
-      enkf_tui_main_menu(enkf_main); 
+      enkf_tui_trace_span_end( span );
+      startup_timing_add( timing_labels , timing_values , "enkf_main_alloc" , &t0 );
+      if (batch)
+        exit_status = run_batch( enkf_main , workflow_list , get_option_value( argc , argv , REPORT_OPTION ));
+      else
+        enkf_main_run_workflows( enkf_main , workflow_list );
+      startup_timing_add( timing_labels , timing_values , "workflows" , &t0 );
+      if (timing)
+        startup_timing_fprintf( timing_labels , timing_values , stdout );
+
+      if (!batch)
+        enkf_tui_main_menu(enkf_main); 
       enkf_main_free(enkf_main);
       site_config_free(site_config);
     }
@@ -171,5 +303,8 @@ int main (int argc , char ** argv) {
     stringlist_free( workflow_list );
     util_abort_free_version_info(); /* No fucking leaks ... */
   }
-  exit(0);
+  stringlist_free( timing_labels );
+  double_vector_free( timing_values );
+  enkf_tui_trace_close( );
+  exit( exit_status );
 }
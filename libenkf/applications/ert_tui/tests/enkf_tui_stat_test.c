@@ -0,0 +1,110 @@
+/*
+   Copyright (C) 2017  Statoil ASA, Norway. 
+    
+   The file 'enkf_tui_stat_test.c' is part of ERT - Ensemble based Reservoir Tool. 
+    
+   ERT is free software: you can redistribute it and/or modify 
+   it under the terms of the GNU General Public License as published by 
+   the Free Software Foundation, either version 3 of the License, or 
+   (at your option) any later version. 
+    
+   ERT is distributed in the hope that it will be useful, but WITHOUT ANY 
+   WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+   FITNESS FOR A PARTICULAR PURPOSE.   
+    
+   See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html> 
+   for more details. 
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <ert/util/test_util.h>
+#include <ert/util/double_vector.h>
+
+#include <enkf_tui_stat.h>
+
+
+static enkf_tui_stat_type * alloc_stat( int data_size ) {
+  double_vector_type * quantiles = double_vector_alloc( 0 , 0 );
+  enkf_tui_stat_type * stat;
+
+  double_vector_append( quantiles , 0.10 );
+  double_vector_append( quantiles , 0.50 );
+  double_vector_append( quantiles , 0.90 );
+  stat = enkf_tui_stat_alloc( data_size , quantiles );
+  double_vector_free( quantiles );
+  return stat;
+}
+
+
+/*
+  With five realizations the quantiles are interpolated between the
+  sorted values 1,2,3,4,5 (cell 0) and 10,20,30,40,50 (cell 1).
+*/
+
+void test_five_realizations() {
+  const double realizations[5][2] = {{3 , 50} , {1 , 10} , {4 , 40} , {5 , 20} , {2 , 30}};
+  enkf_tui_stat_type * stat = alloc_stat( 2 );
+  double P10[2] , P50[2] , P90[2] , mean[2] , std[2];
+
+  for (int iens = 0; iens < 5; iens++)
+    enkf_tui_stat_add_values( stat , realizations[iens] );
+
+  test_assert_int_equal( enkf_tui_stat_get_count( stat ) , 5 );
+  enkf_tui_stat_iget_quantile( stat , 0 , P10 );
+  enkf_tui_stat_iget_quantile( stat , 1 , P50 );
+  enkf_tui_stat_iget_quantile( stat , 2 , P90 );
+  enkf_tui_stat_get_mean( stat , mean );
+  enkf_tui_stat_get_std( stat , std );
+
+  for (int cell = 0; cell < 2; cell++) {
+    test_assert_true( P10[cell] < P50[cell] );
+    test_assert_true( P50[cell] < P90[cell] );
+  }
+
+  test_assert_double_equal( P10[0] , 1.4 );
+  test_assert_double_equal( P50[0] , 3.0 );
+  test_assert_double_equal( P90[0] , 4.6 );
+  test_assert_double_equal( P10[1] , 14 );
+  test_assert_double_equal( P90[1] , 46 );
+  test_assert_double_equal( mean[0] , 3.0 );
+  test_assert_double_equal( std[0] , sqrt( 2.5 ));
+
+  enkf_tui_stat_free( stat );
+}
+
+
+/*
+  Beyond five realizations the P^2 markers are used; the estimates
+  must stay ordered and within the range of the values.
+*/
+
+void test_many_realizations() {
+  enkf_tui_stat_type * stat = alloc_stat( 1 );
+  double P10 , P50 , P90;
+
+  for (int iens = 0; iens < 101; iens++) {
+    double value = (iens * 37) % 101;
+    enkf_tui_stat_add_values( stat , &value );
+  }
+
+  enkf_tui_stat_iget_quantile( stat , 0 , &P10 );
+  enkf_tui_stat_iget_quantile( stat , 1 , &P50 );
+  enkf_tui_stat_iget_quantile( stat , 2 , &P90 );
+
+  test_assert_true( 0 <= P10 );
+  test_assert_true( P10 < P50 );
+  test_assert_true( P50 < P90 );
+  test_assert_true( P90 <= 100 );
+  test_assert_true( fabs( P50 - 50 ) < 5 );
+
+  enkf_tui_stat_free( stat );
+}
+
+
+int main(int argc , char ** argv) {
+  test_five_realizations();
+  test_many_realizations();
+  exit(0);
+}
@@ -1,7 +1,7 @@
 /*
    Copyright (C) 2011  Statoil ASA, Norway. 
     
-   The file 'main.c' is part of ERT - Ensemble based Reservoir Tool. 
+   The file 'upgrade_fs104.c' is part of ERT - Ensemble based Reservoir Tool. 
     
    ERT is free software: you can redistribute it and/or modify 
    it under the terms of the GNU General Public License as published by 
@@ -22,49 +22,50 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
-#include <util.h>
-#include <hash.h>
-#include <stringlist.h>
-#include <block_fs.h>
-#include <msg.h>
+#include <ert/util/util.h>
+#include <ert/util/hash.h>
+#include <ert/util/stringlist.h>
+#include <ert/util/int_vector.h>
+#include <ert/util/double_vector.h>
+#include <ert/util/vector.h>
+#include <ert/util/arg_pack.h>
+#include <ert/util/buffer.h>
+#include <ert/util/block_fs.h>
 
-#include <ecl_sum.h>
-#include <ecl_smspec.h>
+#include <ert/ecl/ecl_sum.h>
+#include <ert/ecl/ecl_smspec.h>
+#include <ert/ecl/smspec_node.h>
 
-#include <config.h>
+#include <ert/config/config_parser.h>
+#include <ert/config/config_content.h>
+#include <ert/config/config_schema_item.h>
 
-#include <local_driver.h>
-#include <lsf_driver.h>
-#include <ext_joblist.h>
+#include <ert/enkf/enkf_main.h>
+#include <ert/enkf/enkf_types.h>
+#include <ert/enkf/fs_types.h>
+#include <ert/enkf/fs_driver.h>
+#include <ert/enkf/block_fs_driver.h>
+#include <ert/enkf/config_keys.h>
 
-#include <enkf_fs.h>
-#include <enkf_main.h>
-#include <enkf_types.h>
-#include <enkf_sched.h>
-#include <config_keys.h>
-#include <enkf_defaults.h>
-#include <enkf_tui_main.h>
-#include <ert_build_info.h>
-#include <site_config_file.h>
-#include <block_fs_driver.h>
-#include <fs_driver.h>
+#include <fs_migration.h>
 
 
 #define BLOCK_FS_DRIVER_INDEX_ID 3002
 
 
-config_type * create_config( ) {
-  config_type * config = config_alloc( );
+static config_parser_type * create_config( ) {
+  config_parser_type * config = config_alloc( );
   config_schema_item_type * item;
 
-  item = config_add_schema_item(config , ENSPATH_KEY , true , false);
-  config_schema_item_set_argc_minmax(item , 1 , 1 , 0 , NULL);
+  item = config_add_schema_item(config , ENSPATH_KEY , true );
+  config_schema_item_set_argc_minmax(item , 1 , 1 );
   
-  item = config_add_schema_item(config , NUM_REALIZATIONS_KEY , true , false);
-  config_schema_item_set_argc_minmax(item , 1 , 1 , 1, (const config_item_types [1]) {CONFIG_INT});
+  item = config_add_schema_item(config , NUM_REALIZATIONS_KEY , true );
+  config_schema_item_set_argc_minmax(item , 1 , 1 );
+  config_schema_item_iset_type( item , 0 , CONFIG_INT );
   
-  item = config_add_schema_item(config , REFCASE_KEY , true , false);
-  config_schema_item_set_argc_minmax(item , 1 , 1 , 1 , NULL );
+  item = config_add_schema_item(config , REFCASE_KEY , true );
+  config_schema_item_set_argc_minmax(item , 1 , 1 );
 
   return config;
 }
@@ -124,140 +125,377 @@ char * check_enspath( const char * ens_path , stringlist_type * case_list ) {
 
 
 
-void upgrade_case( int ens_size , const ecl_sum_type * refcase , const char * enspath , const char * case_path , const char * file) {
-  int num_drivers = 32;
-  int length = ecl_sum_get_last_report_step( refcase );
-  block_fs_type ** fs_list = util_calloc( num_drivers , sizeof * fs_list );
-  buffer_type * buffer = buffer_alloc(100);
-  double_vector_type * vector = double_vector_alloc( 0,0 );
-  int driver_nr;
+#define UPGRADE_JOURNAL_FILE "upgrade_fs104.journal"
+#define UPGRADE_NUM_DRIVERS  32
 
-  
-  for (driver_nr = 0; driver_nr < num_drivers; driver_nr++) {
-    char * mount_file = util_alloc_sprintf( "%s/%s/mod_%d/%s.mnt" , enspath , case_path , driver_nr , file);
-    fs_list[driver_nr] = block_fs_mount( mount_file , 32 , 0 , 1 , 1 , true , false );
-    free( mount_file );
+
+/**
+   The summary keys of a version 104 case are stored as one
+   block_fs entry per (key,tstep,iens):
+
+       <gen_key>.<tstep>.<iens>
+
+   and should be collected in one vector per (key,iens):
+
+       <gen_key>.<iens>
+
+   Returns false if the key can not be split in this way.
+*/
+
+static bool split_summary_key( const char * key , char ** gen_key , int * tstep , int * iens ) {
+  const char * iens_sep = strrchr( key , '.' );
+  const char * tstep_sep;
+  bool valid = false;
+
+  if ((iens_sep == NULL) || (iens_sep == key))
+    return false;
+
+  tstep_sep = iens_sep - 1;
+  while ((tstep_sep > key) && (*tstep_sep != '.'))
+    tstep_sep--;
+
+  if ((*tstep_sep == '.') && (tstep_sep > key)) {
+    char * tstep_string = util_alloc_substring_copy( tstep_sep , 1 , iens_sep - tstep_sep - 1 );
+    if (util_sscanf_int( tstep_string , tstep ) && util_sscanf_int( &iens_sep[1] , iens ) && (*tstep >= 0)) {
+      *gen_key = util_alloc_substring_copy( key , 0 , tstep_sep - key );
+      valid = true;
+    }
+    free( tstep_string );
   }
-  
+  return valid;
+}
+
+
+/**
+   Number of (key,iens) vectors which are assembled, written and have
+   their old entries unlinked in one go. The old entries of one batch
+   are read in file offset order.
+
+   If a previous run was interrupted after the vectors of a batch were
+   written, but before all the old entries were unlinked, the vector
+   is already present; the remaining old entries are then merged into
+   the existing vector instead of replacing it.
+*/
+
+#define UPGRADE_BATCH_SIZE 1024
+
+static void upgrade_driver_batch( block_fs_type * fs , const stringlist_type * file_list , const hash_type * vector_index , const stringlist_type * vector_keys , int batch_offset , int batch_size , buffer_type * buffer) {
+  hash_type * vectors = hash_alloc();
+  int_vector_type * file_pos = int_vector_alloc( 0 , 0 );
+  int i;
+
+  for (i = batch_offset; i < batch_offset + batch_size; i++) {
+    const char * vector_key = stringlist_iget( vector_keys , i );
+    const int_vector_type * pos_list = hash_get( vector_index , vector_key );
+    double_vector_type * vector;
+
+    for (int j = 0; j < int_vector_size( pos_list ); j++)
+      int_vector_append( file_pos , int_vector_iget( pos_list , j ));
+
+    if (block_fs_has_file( fs , vector_key )) {
+      block_fs_fread_realloc_buffer( fs , vector_key , buffer );
+      buffer_fread_time_t( buffer );
+      buffer_fread_int( buffer );
+      vector = double_vector_buffer_fread_alloc( buffer );
+    } else
+      vector = double_vector_alloc( 0 , 0 );
+
+    hash_insert_hash_owned_ref( vectors , vector_key , vector , double_vector_free__ );
+  }
+  int_vector_sort( file_pos );
+
+  for (i = 0; i < int_vector_size( file_pos ); i++) {
+    const char * node_key = stringlist_iget( file_list , int_vector_iget( file_pos , i ));
+    char * gen_key;
+    int tstep , iens;
+
+    if (split_summary_key( node_key , &gen_key , &tstep , &iens )) {
+      char * vector_key = util_alloc_sprintf("%s.%d" , gen_key , iens );
+      double_vector_type * vector = hash_get( vectors , vector_key );
+
+      block_fs_fread_realloc_buffer( fs , node_key , buffer );
+      buffer_fskip( buffer , 12 );
+      double_vector_iset( vector , tstep , buffer_fread_double( buffer ));
+
+      free( vector_key );
+      free( gen_key );
+    }
+  }
+
+  for (i = batch_offset; i < batch_offset + batch_size; i++) {
+    const char * vector_key = stringlist_iget( vector_keys , i );
+    const double_vector_type * vector = hash_get( vectors , vector_key );
+
+    buffer_rewind( buffer );
+    buffer_fwrite_time_t( buffer , time(NULL));
+    buffer_fwrite_int( buffer , SUMMARY );
+    double_vector_buffer_fwrite( vector , buffer );
+    block_fs_fwrite_buffer( fs , vector_key , buffer );
+  }
+
+  for (i = 0; i < int_vector_size( file_pos ); i++)
+    block_fs_unlink_file( fs , stringlist_iget( file_list , int_vector_iget( file_pos , i )));
+
+  int_vector_free( file_pos );
+  hash_free( vectors );
+}
+
+
+/**
+   Upgrades all the summary entries of one mod_%d driver. The index of
+   the block_fs is scanned once; the entries belonging to the summary
+   keys in the refcase are grouped per (key,iens) and then rewritten
+   in batches of UPGRADE_BATCH_SIZE vectors.
+*/
+
+static void upgrade_driver( block_fs_type * fs , const hash_type * gen_keys ) {
+  stringlist_type * file_list = stringlist_alloc_new();
+  hash_type * vector_index    = hash_alloc();
+  stringlist_type * vector_keys;
+
   {
-    const ecl_smspec_type * smspec = ecl_sum_get_smspec( refcase );
-    int num_params = ecl_smspec_get_params_size( smspec );
-    msg_type * msg;
-    {
-      char * prefix = util_alloc_sprintf("Upgrading %s/mod_nnn/%s: " , case_path , file );
-      msg = msg_alloc( prefix , false );
-      free( prefix );
+    vector_type * node_list = block_fs_alloc_filelist( fs , NULL , OFFSET_SORT , false );
+    for (int i = 0; i < vector_get_size( node_list ); i++) {
+      const user_file_node_type * node = vector_iget_const( node_list , i );
+      stringlist_append_copy( file_list , user_file_node_get_filename( node ));
     }
-    msg_show( msg );
-    
-    for (int i=0; i < num_params; i++) {
-      const smspec_node_type * smspec_node = ecl_smspec_iget_node( smspec , i );
-      const char * gen_key = smspec_node_get_gen_key1( smspec_node );
-      {
-        char * progress = util_alloc_sprintf("%4.1f %s" , i * 100.0 / num_params , "%");
-        msg_update( msg , progress );
-        free( progress );
-      }
-      if (gen_key != NULL) {
-        for (int iens = 0; iens < ens_size; iens++) {
-          block_fs_type * fs = fs_list[ iens % num_drivers ];
-          double_vector_reset( vector );
-          for (int tstep = 0; tstep <= length; tstep++) {
-            char * node_key = util_alloc_sprintf("%s.%d.%d" , gen_key , tstep , iens );
-            
-            if (block_fs_has_file( fs , node_key )) {
-              block_fs_fread_realloc_buffer( fs , node_key , buffer );
-              buffer_fskip( buffer , 12 );
-              double_vector_iset( vector , tstep , buffer_fread_double( buffer ));
-              block_fs_unlink_file( fs , node_key );
-            }
-            free( node_key );
-          }
-
-          if (double_vector_size( vector ) > 0) {
-            char * vector_key = util_alloc_sprintf("%s.%d" , gen_key , iens );
-            buffer_rewind( buffer );
-            buffer_fwrite_time_t( buffer , time(NULL));
-            buffer_fwrite_int( buffer , SUMMARY );
-            double_vector_buffer_fwrite( vector , buffer );
-            
-            block_fs_fwrite_buffer( fs , vector_key , buffer );
-            free( vector_key );
-          }
-        }
+    vector_free( node_list );
+  }
+
+  for (int i = 0; i < stringlist_get_size( file_list ); i++) {
+    char * gen_key;
+    int tstep , iens;
+
+    if (split_summary_key( stringlist_iget( file_list , i ) , &gen_key , &tstep , &iens )) {
+      if (hash_has_key( gen_keys , gen_key )) {
+        char * vector_key = util_alloc_sprintf("%s.%d" , gen_key , iens );
+        if (!hash_has_key( vector_index , vector_key ))
+          hash_insert_hash_owned_ref( vector_index , vector_key , int_vector_alloc( 0 , 0 ) , int_vector_free__ );
+        int_vector_append( hash_get( vector_index , vector_key ) , i );
+        free( vector_key );
       }
+      free( gen_key );
     }
-    msg_free( msg , false);
   }
-    
-  double_vector_free( vector );
-  buffer_free( buffer );
-  for (driver_nr = 0; driver_nr < num_drivers; driver_nr++) {
-    block_fs_close( fs_list[driver_nr] , true );
+
+  vector_keys = hash_alloc_stringlist( vector_index );
+  {
+    buffer_type * buffer = buffer_alloc( 100 );
+    int num_vectors = stringlist_get_size( vector_keys );
+    int batch_offset = 0;
+
+    while (batch_offset < num_vectors) {
+      int batch_size = util_int_min( UPGRADE_BATCH_SIZE , num_vectors - batch_offset );
+      upgrade_driver_batch( fs , file_list , vector_index , vector_keys , batch_offset , batch_size , buffer );
+      batch_offset += batch_size;
+    }
+    buffer_free( buffer );
   }
-  free( fs_list );
+
+  stringlist_free( vector_keys );
+  hash_free( vector_index );
+  stringlist_free( file_list );
+}
+
+#undef UPGRADE_BATCH_SIZE
+
+
+static bool upgrade_driver_step( const arg_pack_type * arg ) {
+  const hash_type * gen_keys = arg_pack_iget_const_ptr( arg , 0 );
+  const char * mount_file    = arg_pack_iget_const_ptr( arg , 1 );
+  block_fs_type * fs         = block_fs_mount( mount_file , 32 , 0 , 1 , 1 , true , false , true );
+
+  upgrade_driver( fs , gen_keys );
+  block_fs_close( fs , true );
+  return true;
 }
 
 
+/**
+   The files INDEX.data_0 and INDEX.mnt are moved into the Index/
+   subdirectory; when resuming an interrupted upgrade they may already
+   have been moved, and the kw_list_* entries which have already been
+   renamed are no longer found in the scan.
+*/
+
 void update_index( int ens_size, int length, const char * ens_path , const char * case_path ) {
   char * index_path = util_alloc_sprintf("%s/%s/Index" , ens_path , case_path );
   char * old_path   = util_alloc_sprintf("%s/%s"       , ens_path , case_path );
   
   util_make_path( index_path );
-  util_move_file4( "INDEX.data_0" , NULL , old_path , index_path );
-  util_move_file4( "INDEX.mnt"    , NULL , old_path , index_path );
+  {
+    const char * index_files[2] = { "INDEX.data_0" , "INDEX.mnt" };
+    for (int i = 0; i < 2; i++) {
+      char * old_file = util_alloc_filename( old_path , index_files[i] , NULL );
+      if (util_file_exists( old_file ))
+        util_move_file4( index_files[i] , NULL , old_path , index_path );
+      free( old_file );
+    }
+  }
   
   free( old_path );
 
   {
     char * mount_file = util_alloc_sprintf("%s/INDEX.mnt" , index_path);
-    block_fs_type * index = block_fs_mount( mount_file , 32 , 0 , 1 , 1 , true , false );
+    block_fs_type * index = block_fs_mount( mount_file , 32 , 0 , 1 , 1 , true , false , true );
     buffer_type * buffer = buffer_alloc( 512 );
-    for (int iens = 0; iens < ens_size; iens++)
-      for (int tstep = 0; tstep < length; tstep++) {
-        char * old_key = util_alloc_sprintf("kw_list_%d.%d" , tstep , iens);
-        char * new_key = util_alloc_sprintf("kw_list.%d.%d" , tstep , iens);
+    stringlist_type * old_keys = stringlist_alloc_new();
+    {
+      vector_type * node_list = block_fs_alloc_filelist( index , "kw_list_*" , OFFSET_SORT , false );
+      for (int i = 0; i < vector_get_size( node_list ); i++)
+        stringlist_append_copy( old_keys , user_file_node_get_filename( vector_iget_const( node_list , i )));
+      vector_free( node_list );
+    }
 
-        if (block_fs_has_file( index , old_key )) {
-          block_fs_fread_realloc_buffer( index , old_key , buffer );
-          block_fs_fwrite_buffer( index , new_key , buffer );
-          block_fs_unlink_file( index , old_key );
-        }
-        
-        free( old_key );
+    for (int i = 0; i < stringlist_get_size( old_keys ); i++) {
+      const char * old_key = stringlist_iget( old_keys , i );
+      int tstep , iens;
+
+      if ((sscanf( old_key , "kw_list_%d.%d" , &tstep , &iens ) == 2) && (iens < ens_size) && (tstep < length)) {
+        char * new_key = util_alloc_sprintf("kw_list.%d.%d" , tstep , iens);
+        block_fs_fread_realloc_buffer( index , old_key , buffer );
+        block_fs_fwrite_buffer( index , new_key , buffer );
+        block_fs_unlink_file( index , old_key );
         free( new_key );
       }
-    
+    }
+
+    stringlist_free( old_keys );
+    buffer_free( buffer );
     free( mount_file );
     block_fs_close( index , true );
   }
+  free( index_path );
 }
 
 
-void create_fstab( const char * ens_path , const char * case_path ) {
-  int num_drivers = 32;
+static bool update_index_step( const arg_pack_type * arg ) {
+  const char * enspath   = arg_pack_iget_const_ptr( arg , 0 );
+  const char * case_path = arg_pack_iget_const_ptr( arg , 1 );
+  int ens_size           = arg_pack_iget_int( arg , 2 );
+  int length             = arg_pack_iget_int( arg , 3 );
+
+  update_index( ens_size , length , enspath , case_path );
+  return true;
+}
+
+
+static void create_fstab( const char * ens_path , const char * case_path ) {
   char * mount_point = util_alloc_sprintf("%s/%s" , ens_path , case_path );
   FILE * stream = fs_driver_open_fstab( mount_point , true );
   fs_driver_init_fstab( stream, BLOCK_FS_DRIVER_ID);
   
-  block_fs_driver_create_fs( stream , mount_point , DRIVER_PARAMETER        , num_drivers , "mod_%d" , "PARAMETER");
-  block_fs_driver_create_fs( stream , mount_point , DRIVER_STATIC           , num_drivers , "mod_%d" , "STATIC");
-  block_fs_driver_create_fs( stream , mount_point , DRIVER_DYNAMIC_FORECAST , num_drivers , "mod_%d" , "FORECAST");
-  block_fs_driver_create_fs( stream , mount_point , DRIVER_DYNAMIC_ANALYZED , num_drivers , "mod_%d" , "ANALYZED");
-  block_fs_driver_create_fs( stream , mount_point , DRIVER_INDEX            , 1           , "Index"  , "INDEX");
+  block_fs_driver_create_fs( stream , mount_point , DRIVER_PARAMETER        , UPGRADE_NUM_DRIVERS , "mod_%d" , "PARAMETER");
+  block_fs_driver_create_fs( stream , mount_point , DRIVER_STATIC           , UPGRADE_NUM_DRIVERS , "mod_%d" , "STATIC");
+  block_fs_driver_create_fs( stream , mount_point , DRIVER_DYNAMIC_FORECAST , UPGRADE_NUM_DRIVERS , "mod_%d" , "FORECAST");
+  block_fs_driver_create_fs( stream , mount_point , DRIVER_DYNAMIC_ANALYZED , UPGRADE_NUM_DRIVERS , "mod_%d" , "ANALYZED");
+  block_fs_driver_create_fs( stream , mount_point , DRIVER_INDEX            , 1                   , "Index"  , "INDEX");
   
+  fflush( stream );
+  fsync( fileno( stream ));
   fclose( stream );
   free( mount_point );
 }
 
 
+static bool create_fstab_step( const arg_pack_type * arg ) {
+  const char * enspath   = arg_pack_iget_const_ptr( arg , 0 );
+  const char * case_path = arg_pack_iget_const_ptr( arg , 1 );
+
+  create_fstab( enspath , case_path );
+  return true;
+}
+
+
+/**
+   The upgrade from version 104 is run as an fs_migration with three
+   phases:
+
+     1. One step per (case,file,driver) to collect the summary
+        entries in vectors, and one step per case to move and rename
+        the index.
+
+     2. One step per rewritten block_fs file to compact it.
+
+     3. One step per case to create the fstab.
+
+   The steps of all the cases run concurrently within a phase. Returns
+   false if a step failed, i.e. if the upgrade must be resumed.
+*/
+
+static bool upgrade_cases( fs_migration_type * migration , int ens_size , const ecl_sum_type * refcase , const char * enspath , const stringlist_type * case_list ) {
+  const char * files[2] = { "FORECAST" , "ANALYZED" };
+  const int num_cases   = stringlist_get_size( case_list );
+  const int length      = ecl_sum_get_last_report_step( refcase );
+  const int num_threads = util_int_max( 1 , sysconf( _SC_NPROCESSORS_ONLN ));
+  const int upgrade_phase = fs_migration_add_phase( migration , "Upgrading cases: " );
+  const int compact_phase = fs_migration_add_phase( migration , "Compacting cases: " );
+  const int fstab_phase   = fs_migration_add_phase( migration , "Creating fstab: " );
+  hash_type * gen_keys = hash_alloc();
+
+  {
+    const ecl_smspec_type * smspec = ecl_sum_get_smspec( refcase );
+    int num_params = ecl_smspec_get_params_size( smspec );
+    for (int i=0; i < num_params; i++) {
+      const smspec_node_type * smspec_node = ecl_smspec_iget_node( smspec , i );
+      const char * gen_key = smspec_node_get_gen_key1( smspec_node );
+      if (gen_key != NULL)
+        hash_insert_int( gen_keys , gen_key , i );
+    }
+  }
+
+  for (int ic = 0; ic < num_cases; ic++) {
+    const char * case_path = stringlist_iget( case_list , ic );
+
+    for (int ifile = 0; ifile < 2; ifile++) {
+      for (int driver_nr = 0; driver_nr < UPGRADE_NUM_DRIVERS; driver_nr++) {
+        char * mount_file = util_alloc_sprintf( "%s/%s/mod_%d/%s.mnt" , enspath , case_path , driver_nr , files[ifile]);
+        char * step_name  = util_alloc_sprintf( "UPGRADE %s/mod_%d" , files[ifile] , driver_nr );
+        arg_pack_type * arg_pack = arg_pack_alloc( );
+
+        arg_pack_append_const_ptr( arg_pack , gen_keys );
+        arg_pack_append_owned_ptr( arg_pack , util_alloc_string_copy( mount_file ) , free );
+        fs_migration_add_step( migration , upgrade_phase , ic , step_name , upgrade_driver_step , arg_pack );
+        fs_migration_add_compaction( migration , compact_phase , ic , mount_file );
+
+        free( step_name );
+        free( mount_file );
+      }
+    }
+
+    {
+      char * mount_file = util_alloc_sprintf( "%s/%s/Index/INDEX.mnt" , enspath , case_path );
+      arg_pack_type * arg_pack = arg_pack_alloc( );
+
+      arg_pack_append_const_ptr( arg_pack , enspath );
+      arg_pack_append_const_ptr( arg_pack , case_path );
+      arg_pack_append_int( arg_pack , ens_size );
+      arg_pack_append_int( arg_pack , length );
+      fs_migration_add_step( migration , upgrade_phase , ic , "UPGRADE INDEX" , update_index_step , arg_pack );
+      fs_migration_add_compaction( migration , compact_phase , ic , mount_file );
+      free( mount_file );
+    }
+
+    {
+      arg_pack_type * arg_pack = arg_pack_alloc( );
+      arg_pack_append_const_ptr( arg_pack , enspath );
+      arg_pack_append_const_ptr( arg_pack , case_path );
+      fs_migration_add_step( migration , fstab_phase , ic , "FSTAB" , create_fstab_step , arg_pack );
+    }
+  }
 
+  {
+    bool ok = fs_migration_run( migration , num_threads );
+    hash_free( gen_keys );
+    return ok;
+  }
+}
 
 
 int main (int argc , char ** argv) {
   enkf_main_install_SIGNALS();                     /* Signals common to both tui and gui. */
   signal(SIGINT , util_abort_signal);              /* Control C - tui only.               */
-  enkf_main_init_debug( NULL );
+  util_abort_set_executable( argv[0] );
   if (argc != 2) {
     printf("Usage: upgrade_fs104 config_file\n");
     exit(1);
@@ -267,9 +505,10 @@ int main (int argc , char ** argv) {
     int ens_size;
     ecl_sum_type * refcase;
     {
-      config_type * config = create_config();
-      if (!config_parse( config , model_config_file , "--" , "INCLUDE" , "DEFINE" , CONFIG_UNRECOGNIZED_IGNORE , true )) {
-        config_fprintf_erors( config , stderr );
+      config_parser_type * config = create_config();
+      config_content_type * content = config_parse( config , model_config_file , "--" , "INCLUDE" , "DEFINE" , NULL , CONFIG_UNRECOGNIZED_IGNORE , true );
+      if (!config_content_is_valid( content )) {
+        config_error_fprintf( config_content_get_errors( content ) , true , stderr );
         exit(1);
       }
         
@@ -278,43 +517,40 @@ int main (int argc , char ** argv) {
         util_alloc_file_components(model_config_file , &path , NULL , NULL);
         if (path != NULL) {
           printf("Changing to directory:%s\n" , path);
-          chdir(path);
+          if (chdir(path) != 0)
+            util_exit("Failed to change to directory:%s\n" , path);
         }
         util_safe_free( path );
       }
 
-      ens_size = config_get_value_as_int( config , NUM_REALIZATIONS_KEY );
-      enspath  = util_alloc_string_copy( config_get_value( config , ENSPATH_KEY ));
-      refcase  = ecl_sum_fread_alloc_case( config_get_value( config , REFCASE_KEY ) , ":");
+      ens_size = config_content_get_value_as_int( content , NUM_REALIZATIONS_KEY );
+      enspath  = util_alloc_string_copy( config_content_get_value( content , ENSPATH_KEY ));
+      refcase  = ecl_sum_fread_alloc_case( config_content_get_value( content , REFCASE_KEY ) , ":");
+      config_content_free( content );
       config_free( config );
     }
 
     {
       stringlist_type * case_list = stringlist_alloc_new();
-      int ic;
       char * mount_file = check_enspath( enspath , case_list );
+      fs_migration_type * migration = fs_migration_alloc( enspath , case_list , UPGRADE_JOURNAL_FILE );
       
-      for (ic = 0; ic < stringlist_get_size( case_list ); ic++) {
-        const char * case_path = stringlist_iget( case_list , ic);
-        
-        upgrade_case( ens_size, refcase , enspath , case_path , "FORECAST");
-        upgrade_case( ens_size, refcase , enspath , case_path , "ANALYZED");
-        
-        update_index( ens_size, ecl_sum_get_last_report_step( refcase ), enspath , case_path );
-        create_fstab( enspath , case_path );
-      }
-      {
-        FILE * stream = util_fopen( mount_file , "w");
-        util_fwrite_long(FS_MAGIC_ID , stream);
-        util_fwrite_int( 105 , stream);
-        fclose( stream );
+      if (upgrade_cases( migration , ens_size , refcase , enspath , case_list ))
+        fs_migration_commit( migration , mount_file , 105 );
+      else {
+        fprintf(stderr , "The upgrade did not complete; %s is still version 104. Run upgrade_fs104 again to resume.\n" , enspath );
+        exit(1);
       }
+
+      fs_migration_free( migration );
       stringlist_free( case_list );
       free( mount_file );
-      
     }
     free( enspath );
     ecl_sum_free( refcase );
     util_abort_free_version_info(); /* No fucking leaks ... */
   }
 }
+
+#undef UPGRADE_JOURNAL_FILE
+#undef UPGRADE_NUM_DRIVERS
@@ -100,3 +100,4 @@ from .workflow import Workflow
 from .workflow_runner import WorkflowRunner
 
 from .job_manager import JobManager, assert_file_executable
+from .resource_profile import ResourceProfile
@@ -0,0 +1,256 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+import errno
+import fcntl
+import heapq
+import os
+import select
+import signal
+import time
+
+
+class ChildExit(object):
+    """The result of a supervised child process; the rusage is as
+    returned from os.wait4() and is None if the child was never reaped.
+    The io is the content of /proc/<pid>/io as a dict, read just before
+    the child was reaped; it is None where /proc is not available, and
+    for children killed on their deadline.
+
+    If the child could not be reaped, e.g. because it has already been
+    waited for elsewhere in the process, the exit status is unknown:
+    status is None, error describes the problem and exitCode() returns
+    -1.
+    """
+
+    def __init__(self, pid, status, rusage, timed_out, io=None, error=None):
+        self.pid = pid
+        self.status = status
+        self.rusage = rusage
+        self.timed_out = timed_out
+        self.io = io
+        self.error = error
+
+
+    def exitCode(self):
+        if self.status is None:
+            return -1
+        elif os.WIFEXITED(self.status):
+            return os.WEXITSTATUS(self.status)
+        elif os.WIFSIGNALED(self.status):
+            return 128 + os.WTERMSIG(self.status)
+        return -1
+
+
+
+class ChildSupervisor(object):
+    """Waits for child processes and their deadlines without polling.
+
+    A SIGCHLD handler writes one byte to a non-blocking pipe (the
+    self-pipe trick); wait() blocks in select() on the read end of the
+    pipe, with the time to the first deadline as timeout. When the
+    process is woken up by the pipe the registered children which have
+    exited are reaped with os.wait4(); when a deadline expires the child is
+    killed with SIGKILL and reaped. Only the registered pids are
+    waited for, so children started with e.g. subprocess are not
+    touched.
+
+    A child which leads its own process group, i.e. has called
+    os.setpgid(0, 0) before exec, is killed on its deadline together
+    with all the processes in the group - otherwise the descendants of
+    a killed job would keep running. A child in the process group of
+    the supervisor is killed alone.
+
+    Signal handlers can only be installed from the main thread; when
+    used from another thread the supervisor falls back to a short
+    select() timeout instead of the SIGCHLD wake-up.
+    """
+
+    FALLBACK_TIMEOUT = 0.05
+
+    def __init__(self):
+        self._read_fd, self._write_fd = os.pipe()
+        for fd in (self._read_fd, self._write_fd):
+            flags = fcntl.fcntl(fd, fcntl.F_GETFL)
+            fcntl.fcntl(fd, fcntl.F_SETFL, flags | os.O_NONBLOCK)
+            # The pipe must not leak into the jobs exec'ed by the children.
+            flags = fcntl.fcntl(fd, fcntl.F_GETFD)
+            fcntl.fcntl(fd, fcntl.F_SETFD, flags | fcntl.FD_CLOEXEC)
+
+        self._running = set()
+        self._exited = {}
+        self._deadlines = []
+        try:
+            self._old_handler = signal.signal(signal.SIGCHLD, self._onSigchld)
+            self._have_handler = True
+        except ValueError:
+            self._old_handler = None
+            self._have_handler = False
+
+
+    def close(self):
+        if self._have_handler:
+            signal.signal(signal.SIGCHLD, self._old_handler or signal.SIG_DFL)
+            self._have_handler = False
+        if self._read_fd is not None:
+            os.close(self._read_fd)
+            os.close(self._write_fd)
+            self._read_fd = self._write_fd = None
+
+
+    def _onSigchld(self, signum, frame):
+        try:
+            os.write(self._write_fd, b"\0")
+        except OSError:
+            # The pipe is full - there is already a wake-up pending.
+            pass
+
+
+    def add(self, pid, timeout=None):
+        """Registers a child process; timeout is in seconds, or None."""
+        self._running.add(pid)
+        if timeout:
+            heapq.heappush(self._deadlines, (time.time() + timeout, pid))
+
+
+    def __len__(self):
+        return len(self._running) + len(self._exited)
+
+
+    def _drainPipe(self):
+        try:
+            while os.read(self._read_fd, 4096):
+                pass
+        except OSError as e:
+            if e.errno not in (errno.EAGAIN, errno.EWOULDBLOCK):
+                raise
+
+
+    def _reap(self, pid, options, timed_out, io=None):
+        error = None
+        try:
+            reaped_pid, status, rusage = os.wait4(pid, options)
+        except OSError as e:
+            if e.errno != errno.ECHILD:
+                raise
+            # Someone else has reaped the child, and its exit status is lost.
+            reaped_pid, status, rusage = pid, None, None
+            error = "The process %d was reaped elsewhere - exit status unknown" % pid
+
+        if reaped_pid == pid:
+            self._running.discard(pid)
+            self._exited[pid] = ChildExit(pid, status, rusage, timed_out, io, error)
+
+
+    @staticmethod
+    def _procState(pid):
+        try:
+            with open("/proc/%d/stat" % pid) as f:
+                # The command name in field two can contain spaces.
+                return f.read().rsplit(")", 1)[1].split()[0]
+        except (IOError, IndexError):
+            return None
+
+
+    @staticmethod
+    def _procIo(pid):
+        try:
+            io = {}
+            with open("/proc/%d/io" % pid) as f:
+                for line in f:
+                    key, value = line.split(":")
+                    io[key.strip()] = int(value)
+            return io
+        except (IOError, ValueError):
+            return None
+
+
+    def _reapExited(self):
+        # An exited child is a zombie until it is reaped, and its
+        # /proc/<pid>/io - which includes the I/O of the descendants it
+        # has reaped - can still be read.
+        for pid in list(self._running):
+            state = self._procState(pid)
+            if state is None:
+                self._reap(pid, os.WNOHANG, False)
+            elif state == "Z":
+                self._reap(pid, 0, False, self._procIo(pid))
+
+
+    @staticmethod
+    def _kill(pid):
+        try:
+            if os.getpgid(pid) == pid:
+                os.killpg(pid, signal.SIGKILL)
+            else:
+                os.kill(pid, signal.SIGKILL)
+        except OSError:
+            # The child has already exited.
+            pass
+
+
+    def _expireDeadlines(self):
+        now = time.time()
+        while self._deadlines and self._deadlines[0][0] <= now:
+            _, pid = heapq.heappop(self._deadlines)
+            if pid in self._running:
+                self._kill(pid)
+                self._reap(pid, 0, True)
+
+
+    def _nextTimeout(self):
+        while self._deadlines and self._deadlines[0][1] not in self._running:
+            heapq.heappop(self._deadlines)
+
+        timeout = None
+        if self._deadlines:
+            timeout = max(0, self._deadlines[0][0] - time.time())
+
+        if not self._have_handler:
+            if timeout is None or timeout > self.FALLBACK_TIMEOUT:
+                timeout = self.FALLBACK_TIMEOUT
+        return timeout
+
+
+    def wait(self, pid=None):
+        """Blocks until the child pid, or any registered child if pid is
+        None, has exited or been killed on its deadline, and returns a
+        ChildExit instance.
+        """
+        if pid is not None and pid not in self._running and pid not in self._exited:
+            raise KeyError("The pid:%d is not supervised" % pid)
+
+        while True:
+            self._reapExited()
+            self._expireDeadlines()
+
+            if pid is None:
+                if self._exited:
+                    return self._exited.pop(next(iter(self._exited)))
+                if not self._running:
+                    raise ValueError("No supervised children")
+            elif pid in self._exited:
+                return self._exited.pop(pid)
+
+            try:
+                ready, _, _ = select.select([self._read_fd], [], [], self._nextTimeout())
+            except select.error as e:
+                if e.args[0] != errno.EINTR:
+                    raise
+                ready = []
+
+            if ready:
+                self._drainPipe()
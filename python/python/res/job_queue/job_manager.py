@@ -29,6 +29,9 @@ import requests
 import json
 import imp
 
+from .child_supervisor import ChildSupervisor
+from .output_manifest import write_manifest, write_durable, declared_output_files
+
 
 def redirect(file, fd, open_mode):
     new_fd = os.open(file, open_mode)
@@ -87,6 +90,44 @@ def assert_file_executable(fname):
         raise IOError("%s is not an executable!" %fname)
 
 
+def resource_record(job, start_time, end_time, exit_status, timed_out, rusage, io):
+    """Returns the resource record of one job run as a dict; the records
+    are aggregated by ResourceProfile. The rusage is as returned from
+    os.wait4(), and the io is /proc/<pid>/io as a dict; both can be
+    None. The I/O bytes are from the io when available, otherwise from
+    the block counts in the rusage.
+
+    The job_dispatch.py script has a copy of this function, since it
+    can not import res; keep the two in sync.
+    """
+    record = {"job"         : job["name"],
+              "executable"  : job.get("executable"),
+              "node"        : socket.gethostname(),
+              "run_path"    : os.getcwd(),
+              "start_time"  : start_time,
+              "end_time"    : end_time,
+              "wall_s"      : end_time - start_time,
+              "exit_status" : exit_status,
+              "timed_out"   : timed_out}
+
+    if rusage is not None:
+        record.update({"cpu_user_s"         : rusage.ru_utime,
+                       "cpu_sys_s"          : rusage.ru_stime,
+                       "max_rss_kb"         : rusage.ru_maxrss,
+                       "read_bytes"         : rusage.ru_inblock * 512,
+                       "write_bytes"        : rusage.ru_oublock * 512,
+                       "vol_ctx_switches"   : rusage.ru_nvcsw,
+                       "invol_ctx_switches" : rusage.ru_nivcsw,
+                       "major_page_faults"  : rusage.ru_majflt})
+
+    if io is not None:
+        record.update({"read_bytes"  : io.get("read_bytes", 0),
+                       "write_bytes" : io.get("write_bytes", 0),
+                       "rchar"       : io.get("rchar", 0),
+                       "wchar"       : io.get("wchar", 0)})
+    return record
+
+
 def _jsonGet(data, key, err_msg=None):
     if err_msg is None:
         err_msg = "JSON-file did not contain a %s." % key
@@ -99,16 +140,17 @@ class JobManager(object):
     LOG_file      = "JOB_LOG"
     EXIT_file     = "ERROR"
     STATUS_file   = "STATUS"
+    RESOURCE_file = "STATUS.jsonl"
     OK_file       = "OK"
 
     DEFAULT_UMASK =  0
-    sleep_time    =  10  # Time to sleep before exiting the script - to let the disks sync up.
 
 
 
     def __init__(self, module_file="jobs.py", json_file="jobs.json", error_url=None):
         self._job_map = {}
         self._error_url = error_url
+        self.num_cpu = 1
         if json_file is not None and os.path.isfile(json_file):
             self._loadJson(json_file)
         else:
@@ -127,6 +169,7 @@ class JobManager(object):
         cond_unlink("EXIT")
         cond_unlink(self.EXIT_file)
         cond_unlink(self.STATUS_file)
+        cond_unlink(self.RESOURCE_file)
         cond_unlink(self.OK_file)
         self.initStatusFile()
 
@@ -144,12 +187,15 @@ class JobManager(object):
         os.umask(int(umask, 8))
 
         self.job_list = _jsonGet(jobs_data, "jobList")
+        self.num_cpu = int(jobs_data.get("num_cpu", 1))
         self._ensureCompatibleJobList()
         self._buildJobMap()
+        self._buildDependencies()
 
     def _loadModule(self, module_file):
         if module_file is None:
             self.job_list = []
+            self._dependencies = []
             return
 
         try:
@@ -159,8 +205,10 @@ class JobManager(object):
 
         # The internalization of the job items is currently *EXTREMELY* basic.
         self.job_list = jobs_module.jobList
+        self.num_cpu = int(getattr(jobs_module, "num_cpu", 1))
         self._ensureCompatibleJobList()
         self._buildJobMap()
+        self._buildDependencies()
 
         if hasattr(jobs_module, "umask"):
             umask = jobs_module.umask
@@ -184,6 +232,41 @@ class JobManager(object):
             if "stdout" in job:
                 job["stdout"] = "%s.%d" % (job["stdout"], index)
 
+    def _buildDependencies(self):
+        """Jobs can optionally declare which jobs they depend on, either
+        explicitly with a list of job names in 'depends_on', or by
+        being one of a run of consecutive jobs with the same
+        'parallel_group'; the jobs in a group are independent of each
+        other, and depend on all the jobs before the group. A job
+        without any of these keys depends on all the jobs before it,
+        i.e. by default the jobs run strictly in order.
+
+        A job can only depend on jobs listed before it, so the
+        dependencies can not have cycles.
+        """
+        self._dependencies = []
+        earlier = {}
+        group, group_deps = None, None
+        for index, job in enumerate(self.job_list):
+            if job.get("depends_on") is not None:
+                deps = set()
+                for name in job["depends_on"]:
+                    if name not in earlier:
+                        raise ValueError("Job:%s depends on:%s which is not listed before it" % (job["name"], name))
+                    deps.add(earlier[name])
+                group = None
+            elif job.get("parallel_group") is not None:
+                if job["parallel_group"] != group:
+                    group, group_deps = job["parallel_group"], set(range(index))
+                deps = group_deps
+            else:
+                deps = set(range(index))
+                group = None
+
+            self._dependencies.append(deps)
+            earlier[job["name"]] = index
+
+
     def __contains__(self, key):
         return key in self._job_map
 
@@ -222,11 +305,42 @@ class JobManager(object):
             f.write("%02d:%02d:%02d  %s\n" % (now.tm_hour, now.tm_min, now.tm_sec, status))
 
 
+    def writeStatusLine(self, job, start_time, exit_status, error_msg):
+        """Writes the complete STATUS line of a job in one write, in the
+        same format as startStatus() + completeStatus(); used when jobs
+        run concurrently.
+        """
+        now = time.localtime()
+        if exit_status == 0:
+            status = ""
+        else:
+            status = " EXIT: %d/%s" % (exit_status, error_msg)
+
+        with open(self.STATUS_file, "a") as f:
+            f.write("%-32s: %02d:%02d:%02d .... %02d:%02d:%02d  %s\n" % (job["name"],
+                                                                      start_time.tm_hour, start_time.tm_min, start_time.tm_sec,
+                                                                      now.tm_hour, now.tm_min, now.tm_sec, status))
+
+
+    def writeResourceRecord(self, job, start_time, child, exit_status):
+        """Appends one JSON line with the resource usage of a completed
+        job to the RESOURCE_file; the usage is from the rusage of the
+        job process, which includes the descendants it has waited for.
+        """
+        record = resource_record(job, start_time, time.time(), exit_status, child.timed_out, child.rusage, child.io)
+        with open(self.RESOURCE_file, "a") as f:
+            f.write(json.dumps(record, sort_keys=True) + "\n")
+
+
     def createOKFile(self):
+        # The output is fsync'ed and listed in a manifest before the OK
+        # file is written, i.e. when the OK file exists the output is on
+        # disk - there is no need to sleep and let the disks sync up.
+        run_start = time.mktime(self.start_time.timetuple())
+        write_manifest(os.getcwd(), declared_output_files(self.job_list), run_start)
+
         now = time.localtime()
-        with open(self.OK_file, "w") as f:
-            f.write("All jobs complete %02d:%02d:%02d \n" % (now.tm_hour, now.tm_min, now.tm_sec))
-        time.sleep(self.sleep_time)   # Let the disks sync up
+        write_durable(self.OK_file, "All jobs complete %02d:%02d:%02d \n" % (now.tm_hour, now.tm_min, now.tm_sec))
 
 
     def getStartTime(self):
@@ -358,23 +472,125 @@ class JobManager(object):
                      job.get('executable'), args))
 
 
-    def runJob(self, job):
+    def _startJob(self, job, supervisor):
         assert_file_executable(job.get('executable'))
         self.addLogLine(job)
         pid = os.fork()
-        exit_status, err_msg = 0, ''
         if pid == 0:
-            self.execJob(job)
+            try:
+                # In a process group of its own, so that the job and
+                # its descendants are killed together on a timeout.
+                os.setpgid(0, 0)
+                self.execJob(job)
+            finally:
+                # Only reached if the exec failed; must not return
+                # into the code of the parent.
+                os._exit(127)
+
+        try:
+            # Also from the parent, to close the race with a timeout
+            # before the child has run setpgid().
+            os.setpgid(pid, pid)
+        except OSError:
+            # The child has already exec'ed or exited.
+            pass
+
+        timeout = None
+        if job.get("max_running_minutes"):
+            timeout = job["max_running_minutes"] * 60
+        supervisor.add(pid, timeout)
+        return pid
+
+
+    def runJob(self, job):
+        # The supervisor is created before the fork, so that the
+        # SIGCHLD handler is in place even if the job exits at once.
+        supervisor = ChildSupervisor()
+        try:
+            start_time = time.time()
+            pid = self._startJob(job, supervisor)
+            child = supervisor.wait(pid)
+        finally:
+            supervisor.close()
+
+        exit_status, err_msg = self._exitStatus(job, child)
+        self.writeResourceRecord(job, start_time, child, exit_status)
+        return exit_status, err_msg
+
+
+    def runJobs(self):
+        """Runs all the jobs, starting each job as soon as the jobs it
+        depends on have completed, and with at most num_cpu jobs running
+        at the same time. The STATUS line is written when a job
+        completes, and a failing job is added to the ERROR file. After
+        a failure no new jobs are started, but the running jobs are
+        allowed to complete.
+
+        Returns (exit_status, error_msg) of the first failed job, or
+        (0, '') if all the jobs completed successfully.
+
+        This is a library function: the forward model in the run path
+        is run by share/bin/job_dispatch.py, which runs under the system
+        python without the res package and does not use JobManager. That
+        script runs the jobs strictly in order, and warns that the
+        depends_on and parallel_group keys are ignored.
+        """
+        pending = list(range(len(self.job_list)))
+        running = {}
+        completed = set()
+        failure = None
+        supervisor = ChildSupervisor()
+        try:
+            while running or (pending and failure is None):
+                if failure is None:
+                    for index in list(pending):
+                        if len(running) >= max(1, self.num_cpu):
+                            break
+                        if self._dependencies[index] <= completed:
+                            start_time = time.time()
+                            pid = self._startJob(self.job_list[index], supervisor)
+                            running[pid] = (index, start_time)
+                            pending.remove(index)
+
+                child = supervisor.wait()
+                index, start_time = running.pop(child.pid)
+                job = self.job_list[index]
+                exit_status, error_msg = self._exitStatus(job, child)
+                self.writeStatusLine(job, time.localtime(start_time), exit_status, error_msg)
+                self.writeResourceRecord(job, start_time, child, exit_status)
+                if exit_status == 0:
+                    completed.add(index)
+                else:
+                    self.dump_EXIT_file(job, error_msg)
+                    if failure is None:
+                        failure = (exit_status, error_msg)
+        finally:
+            supervisor.close()
+
+        return failure or (0, '')
+
+
+    def _exitStatus(self, job, child):
+        exit_status, err_msg = 0, ''
+        if child.timed_out:
+            exit_status = -1
+            err_msg = "Job:%s has been running for more than %d minutes - explicitly killed." % (job["name"],
+                                                                                                 job["max_running_minutes"])
+        elif child.status is None:
+            exit_status = -1
+            err_msg = "Executable: %s - %s" % (job.get('executable'), child.error)
         else:
-            _, exit_status = os.waitpid(pid, 0)
-            # The exit_status returned from os.waitpid encodes
-            # both the exit status of the external application,
-            # and in case the job was killed by a signal - the
-            # number of that signal.
-            exit_status = os.WEXITSTATUS(exit_status)
-        if exit_status != 0:
-            err_msg = "Executable: %s failed with exit code: %s" % (job.get('executable'),
-                                                                    exit_status)
+            # The status returned from os.wait4 encodes both the exit
+            # status of the external application, and in case the job
+            # was killed by a signal - the number of that signal; the
+            # WEXITSTATUS of a signalled job is zero.
+            exit_status = child.exitCode()
+            if os.WIFSIGNALED(child.status):
+                err_msg = "Executable: %s killed by signal: %d" % (job.get('executable'),
+                                                                   os.WTERMSIG(child.status))
+            elif exit_status != 0:
+                err_msg = "Executable: %s failed with exit code: %s" % (job.get('executable'),
+                                                                        exit_status)
 
         return exit_status, err_msg
 
@@ -0,0 +1,165 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+"""Durable completion of a forward model run.
+
+Instead of sleeping a fixed time before the OK file is written, the
+files written by the forward model are fsync'ed and listed in a
+manifest, and the manifest and the OK file are written atomically and
+fsync'ed. The manifest has one line per file:
+
+    <md5 or ->  <size>  <path relative to the run path>
+
+The md5 checksum is only computed for the declared output files of
+the jobs (target_file and output_files); the other files written
+during the run, like the large simulator output, are listed with the
+size only. The manifest is written before the OK file, so when the OK
+file exists the manifest is complete, and verify_manifest() can check
+the run path against it.
+
+Future work: verify_manifest() is not called when results are loaded.
+The loader, enkf_main_load_from_forward_model(), is in libres and
+only checks the OK file; verifying the manifest there is left for a
+change to libres.
+"""
+
+import hashlib
+import os
+
+
+MANIFEST_file = "OUTPUT_MANIFEST"
+NO_CHECKSUM = "-"
+
+
+def fsync_file(path):
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+    finally:
+        os.close(fd)
+
+
+def fsync_directory(path):
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+    except OSError:
+        # Not all filesystems support fsync() on directories.
+        pass
+    finally:
+        os.close(fd)
+
+
+def file_checksum(path, block_size=1024 * 1024):
+    md5 = hashlib.md5()
+    with open(path, "rb") as f:
+        while True:
+            block = f.read(block_size)
+            if not block:
+                break
+            md5.update(block)
+    return md5.hexdigest()
+
+
+def write_durable(path, content):
+    """Writes content to path via a temporary file which is fsync'ed and
+    renamed, i.e. path is either missing or complete.
+    """
+    tmp_path = "%s.tmp" % path
+    with open(tmp_path, "w") as f:
+        f.write(content)
+        f.flush()
+        os.fsync(f.fileno())
+    os.rename(tmp_path, path)
+    fsync_directory(os.path.dirname(os.path.abspath(path)))
+
+
+def declared_output_files(job_list):
+    files = []
+    for job in job_list:
+        if job.get("target_file"):
+            files.append(job["target_file"])
+        for output_file in job.get("output_files") or []:
+            files.append(output_file)
+    return files
+
+
+def _written_files(run_path, start_time, skip):
+    files = []
+    for dirpath, _, filenames in os.walk(run_path):
+        for filename in filenames:
+            full_path = os.path.join(dirpath, filename)
+            rel_path = os.path.relpath(full_path, run_path)
+            if rel_path in skip or os.path.islink(full_path) or not os.path.isfile(full_path):
+                continue
+            if os.path.getmtime(full_path) >= start_time:
+                files.append(rel_path)
+    return files
+
+
+def write_manifest(run_path, declared_files, start_time, manifest_file=MANIFEST_file):
+    """Fsyncs all the files in run_path modified after start_time, and the
+    declared files, and writes the manifest. Declared files which do not
+    exist are not listed; it is up to the jobs to flag them as errors.
+    """
+    declared = set()
+    for path in declared_files:
+        if os.path.isabs(path):
+            path = os.path.relpath(path, run_path)
+        if os.path.isfile(os.path.join(run_path, path)):
+            declared.add(os.path.normpath(path))
+
+    skip = set([manifest_file, "%s.tmp" % manifest_file])
+    files = sorted(declared.union(_written_files(run_path, start_time, skip)))
+    directories = set()
+    lines = []
+    for path in files:
+        full_path = os.path.join(run_path, path)
+        fsync_file(full_path)
+        directories.add(os.path.dirname(full_path))
+
+        if path in declared:
+            checksum = file_checksum(full_path)
+        else:
+            checksum = NO_CHECKSUM
+        lines.append("%s  %d  %s\n" % (checksum, os.path.getsize(full_path), path))
+
+    for directory in directories:
+        fsync_directory(directory)
+
+    write_durable(os.path.join(run_path, manifest_file), "".join(lines))
+
+
+def verify_manifest(run_path, manifest_file=MANIFEST_file):
+    """Returns a list of error messages, empty if all the files in the
+    manifest are present with the recorded size and checksum.
+    """
+    errors = []
+    manifest_path = os.path.join(run_path, manifest_file)
+    if not os.path.isfile(manifest_path):
+        return ["Could not find manifest:%s" % manifest_path]
+
+    with open(manifest_path) as f:
+        for line in f:
+            checksum, size, path = line.rstrip("\n").split("  ", 2)
+            full_path = os.path.join(run_path, path)
+            if not os.path.isfile(full_path):
+                errors.append("Missing file:%s" % path)
+            elif os.path.getsize(full_path) != int(size):
+                errors.append("Size mismatch for:%s %d != %s" % (path, os.path.getsize(full_path), size))
+            elif checksum != NO_CHECKSUM and file_checksum(full_path) != checksum:
+                errors.append("Checksum mismatch for:%s" % path)
+    return errors
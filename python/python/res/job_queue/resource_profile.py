@@ -0,0 +1,158 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+
+"""Per job type resource profiles.
+
+The JobManager appends one JSON record per forward model job to the
+STATUS.jsonl file in the run path, with the wall time, user and system
+cpu time, max RSS, I/O bytes and context switches of the job. The
+ResourceProfile class loads these files from many run paths and
+aggregates the records per job name, e.g.:
+
+    profile = ResourceProfile.load("simulations/realization*/iter-0")
+    profile.fprintf(sys.stdout)
+"""
+
+import glob
+import json
+import os
+
+from .job_manager import JobManager
+
+
+class ResourceProfile(object):
+
+    FIELDS = ["wall_s", "cpu_user_s", "cpu_sys_s", "max_rss_kb",
+              "read_bytes", "write_bytes", "vol_ctx_switches", "invol_ctx_switches"]
+
+    def __init__(self):
+        self._records = {}
+
+
+    @classmethod
+    def load(cls, *run_path_patterns):
+        """Creates a profile from the status files in all the run paths
+        matching the glob patterns; run paths without a status file are
+        ignored.
+        """
+        profile = cls()
+        for pattern in run_path_patterns:
+            for run_path in sorted(glob.glob(pattern)):
+                status_file = os.path.join(run_path, JobManager.RESOURCE_file)
+                if os.path.isfile(status_file):
+                    profile.addFile(status_file)
+        return profile
+
+
+    def addFile(self, status_file):
+        with open(status_file) as f:
+            for line in f:
+                line = line.strip()
+                if not line:
+                    continue
+                try:
+                    record = json.loads(line)
+                except ValueError:
+                    # A partial line from a job which was killed.
+                    continue
+                self.addRecord(record)
+
+
+    def addRecord(self, record):
+        self._records.setdefault(record["job"], []).append(record)
+
+
+    def jobNames(self):
+        return sorted(self._records.keys())
+
+
+    def __len__(self):
+        return sum(len(records) for records in self._records.values())
+
+
+    def __contains__(self, job_name):
+        return job_name in self._records
+
+
+    @staticmethod
+    def _percentile(sorted_values, p):
+        index = (len(sorted_values) - 1) * p / 100.0
+        lower = int(index)
+        upper = min(lower + 1, len(sorted_values) - 1)
+        return sorted_values[lower] + (sorted_values[upper] - sorted_values[lower]) * (index - lower)
+
+
+    def summary(self, job_name):
+        """Returns a dict with the count, the number of failed and timed
+        out runs, and for each of the FIELDS a dict with mean, p50, p90
+        and max over the runs which have that field. The cpu_fraction is
+        the total cpu time divided by the total wall time; a value well
+        below one indicates a job which is waiting for I/O.
+        """
+        records = self._records[job_name]
+        summary = {"job"       : job_name,
+                   "count"     : len(records),
+                   "failed"    : sum(1 for r in records if r.get("exit_status")),
+                   "timed_out" : sum(1 for r in records if r.get("timed_out"))}
+
+        for field in self.FIELDS:
+            values = sorted(r[field] for r in records if r.get(field) is not None)
+            if values:
+                summary[field] = {"mean" : sum(values) / float(len(values)),
+                                  "p50"  : self._percentile(values, 50),
+                                  "p90"  : self._percentile(values, 90),
+                                  "max"  : values[-1]}
+
+        wall = sum(r.get("wall_s", 0) for r in records)
+        cpu = sum(r.get("cpu_user_s", 0) + r.get("cpu_sys_s", 0) for r in records)
+        summary["cpu_fraction"] = cpu / wall if wall > 0 else None
+        return summary
+
+
+    def summaries(self):
+        return [self.summary(job_name) for job_name in self.jobNames()]
+
+
+    def fprintf(self, stream):
+        header = "%-24s %6s %6s %10s %10s %10s %12s %12s %12s"
+        row = "%-24s %6d %6d %10.2f %10.2f %10.2f %12d %12d %12d"
+        stream.write(header % ("Job", "Count", "Failed", "Wall p50", "Wall p90", "Cpu frac",
+                               "RSS max kB", "Read MB", "Write MB") + "\n")
+        for s in self.summaries():
+            stream.write(row % (s["job"][:24], s["count"], s["failed"],
+                                s.get("wall_s", {}).get("p50", 0),
+                                s.get("wall_s", {}).get("p90", 0),
+                                s["cpu_fraction"] or 0,
+                                s.get("max_rss_kb", {}).get("max", 0),
+                                s.get("read_bytes", {}).get("mean", 0) / 1.0e6,
+                                s.get("write_bytes", {}).get("mean", 0) / 1.0e6) + "\n")
+
+
+    def writeCSV(self, filename):
+        columns = ["job", "count", "failed", "timed_out", "cpu_fraction"]
+        for field in self.FIELDS:
+            for stat in ("mean", "p50", "p90", "max"):
+                columns.append("%s_%s" % (field, stat))
+
+        with open(filename, "w") as f:
+            f.write(",".join(columns) + "\n")
+            for s in self.summaries():
+                values = [s["job"], s["count"], s["failed"], s["timed_out"], s["cpu_fraction"]]
+                for field in self.FIELDS:
+                    for stat in ("mean", "p50", "p90", "max"):
+                        values.append(s.get(field, {}).get(stat))
+                f.write(",".join("" if v is None else str(v) for v in values) + "\n")
@@ -0,0 +1,144 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+import os
+import signal
+import time
+
+from ecl.test import ExtendedTestCase, TestAreaContext
+from res.job_queue.child_supervisor import ChildSupervisor
+
+
+def fork_exec(argv, own_group=False):
+    pid = os.fork()
+    if pid == 0:
+        try:
+            if own_group:
+                os.setpgid(0, 0)
+            os.execvp(argv[0], argv)
+        finally:
+            os._exit(127)
+    return pid
+
+
+def pid_alive(pid):
+    # A killed orphan can linger as a zombie until init reaps it.
+    try:
+        with open("/proc/%d/stat" % pid) as f:
+            return f.read().rsplit(")", 1)[1].split()[0] != "Z"
+    except IOError:
+        return False
+
+
+class ChildSupervisorTest(ExtendedTestCase):
+
+    def setUp(self):
+        self.supervisor = ChildSupervisor()
+
+    def tearDown(self):
+        self.supervisor.close()
+
+
+    def test_immediate_exit(self):
+        pid = os.fork()
+        if pid == 0:
+            os._exit(3)
+
+        self.supervisor.add(pid, 60)
+        start = time.time()
+        child = self.supervisor.wait(pid)
+        self.assertLess(time.time() - start, 5)
+        self.assertEqual(child.pid, pid)
+        self.assertFalse(child.timed_out)
+        self.assertEqual(child.exitCode(), 3)
+        self.assertIsNotNone(child.rusage)
+        self.assertEqual(len(self.supervisor), 0)
+
+
+    def test_signalled_exit(self):
+        pid = fork_exec(["sleep", "60"])
+        self.supervisor.add(pid)
+        os.kill(pid, signal.SIGTERM)
+
+        child = self.supervisor.wait(pid)
+        self.assertFalse(child.timed_out)
+        self.assertEqual(child.exitCode(), 128 + signal.SIGTERM)
+
+
+    def test_deadline(self):
+        pid = fork_exec(["sleep", "60"])
+        self.supervisor.add(pid, 0.25)
+        start = time.time()
+        child = self.supervisor.wait(pid)
+        elapsed = time.time() - start
+
+        self.assertTrue(child.timed_out)
+        self.assertEqual(child.exitCode(), 128 + signal.SIGKILL)
+        self.assertGreaterEqual(elapsed, 0.2)
+        self.assertLess(elapsed, 5)
+
+
+    def test_deadline_kills_process_group(self):
+        with TestAreaContext("child_supervisor/process_group"):
+            pid = fork_exec(["sh", "-c", "sleep 60 & echo $! > sleep_pid; wait"], own_group=True)
+            self.supervisor.add(pid, 0.5)
+            child = self.supervisor.wait(pid)
+            self.assertTrue(child.timed_out)
+
+            with open("sleep_pid") as f:
+                sleep_pid = int(f.read())
+
+            for _ in range(50):
+                if not pid_alive(sleep_pid):
+                    break
+                time.sleep(0.05)
+            self.assertFalse(pid_alive(sleep_pid))
+
+
+    def test_wait_any(self):
+        pids = set()
+        for exit_code in (0, 1):
+            pid = os.fork()
+            if pid == 0:
+                os._exit(exit_code)
+            self.supervisor.add(pid)
+            pids.add(pid)
+
+        reaped = set()
+        while len(self.supervisor) > 0:
+            reaped.add(self.supervisor.wait().pid)
+        self.assertEqual(reaped, pids)
+
+        with self.assertRaises(ValueError):
+            self.supervisor.wait()
+
+
+    def test_reaped_elsewhere(self):
+        pid = os.fork()
+        if pid == 0:
+            os._exit(0)
+
+        self.supervisor.add(pid)
+        os.waitpid(pid, 0)
+        child = self.supervisor.wait(pid)
+        self.assertIsNone(child.status)
+        self.assertIsNotNone(child.error)
+        self.assertEqual(child.exitCode(), -1)
+
+
+    def test_unknown_pid(self):
+        with self.assertRaises(KeyError):
+            self.supervisor.wait(os.getpid())
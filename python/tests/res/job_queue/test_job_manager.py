@@ -0,0 +1,163 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+import json
+import os
+import stat
+
+from ecl.test import ExtendedTestCase, TestAreaContext
+from res.job_queue import JobManager
+from res.job_queue.child_supervisor import ChildExit
+
+
+def create_script(name, content):
+    with open(name, "w") as f:
+        f.write("#!/bin/sh\n%s\n" % content)
+    os.chmod(name, os.stat(name).st_mode | stat.S_IXUSR)
+    return os.path.abspath(name)
+
+
+def create_jobs_json(job_list, num_cpu=1):
+    for job in job_list:
+        job.setdefault("executable", create_script("true.sh", "exit 0"))
+        job.setdefault("argList", [])
+        job.setdefault("stdout", "%s.stdout" % job["name"])
+        job.setdefault("stderr", "%s.stderr" % job["name"])
+
+    with open("jobs.json", "w") as f:
+        json.dump({"umask" : "0022", "num_cpu" : num_cpu, "jobList" : job_list}, f)
+
+
+class JobManagerTest(ExtendedTestCase):
+
+    def assertDependencies(self, job_list, expected):
+        create_jobs_json(job_list)
+        job_manager = JobManager()
+        self.assertEqual([sorted(deps) for deps in job_manager._dependencies], expected)
+
+
+    def test_default_dependencies(self):
+        with TestAreaContext("job_manager/default"):
+            self.assertDependencies([{"name" : "A"}, {"name" : "B"}, {"name" : "C"}],
+                                    [[], [0], [0, 1]])
+
+
+    def test_depends_on(self):
+        with TestAreaContext("job_manager/depends_on"):
+            self.assertDependencies([{"name" : "A"},
+                                     {"name" : "B"},
+                                     {"name" : "C", "depends_on" : ["A"]},
+                                     {"name" : "D", "depends_on" : []},
+                                     {"name" : "E"}],
+                                    [[], [0], [0], [], [0, 1, 2, 3]])
+
+
+    def test_parallel_group(self):
+        with TestAreaContext("job_manager/parallel_group"):
+            self.assertDependencies([{"name" : "A"},
+                                     {"name" : "B", "parallel_group" : "g1"},
+                                     {"name" : "C", "parallel_group" : "g1"},
+                                     {"name" : "D", "parallel_group" : "g2"},
+                                     {"name" : "E", "parallel_group" : "g2"},
+                                     {"name" : "F"}],
+                                    [[], [0], [0], [0, 1, 2], [0, 1, 2], [0, 1, 2, 3, 4]])
+
+
+    def test_parallel_group_runs(self):
+        # Only consecutive jobs form a group; the same group name after
+        # another job starts a new group.
+        with TestAreaContext("job_manager/parallel_group_runs"):
+            self.assertDependencies([{"name" : "A", "parallel_group" : "g"},
+                                     {"name" : "B", "parallel_group" : "g"},
+                                     {"name" : "C"},
+                                     {"name" : "D", "parallel_group" : "g"},
+                                     {"name" : "E", "parallel_group" : "g"}],
+                                    [[], [], [0, 1], [0, 1, 2], [0, 1, 2]])
+
+
+    def test_depends_on_later_job(self):
+        with TestAreaContext("job_manager/later_job"):
+            create_jobs_json([{"name" : "A", "depends_on" : ["B"]}, {"name" : "B"}])
+            with self.assertRaises(ValueError):
+                JobManager()
+
+
+    def test_run_jobs(self):
+        with TestAreaContext("job_manager/run_jobs"):
+            create_jobs_json([{"name" : "A", "executable" : create_script("a.sh", "touch A.done")},
+                              {"name" : "B", "executable" : create_script("b.sh", "touch B.done"), "depends_on" : ["A"]}],
+                             num_cpu = 2)
+            job_manager = JobManager()
+            self.assertEqual(job_manager.runJobs(), (0, ''))
+            self.assertTrue(os.path.isfile("A.done"))
+            self.assertTrue(os.path.isfile("B.done"))
+
+            with open(JobManager.RESOURCE_file) as f:
+                records = [json.loads(line) for line in f]
+            self.assertEqual(sorted(r["job"] for r in records), ["A", "B"])
+
+
+    def test_signalled_job_fails(self):
+        with TestAreaContext("job_manager/signalled"):
+            create_jobs_json([{"name" : "A", "executable" : create_script("a.sh", "kill -9 $$")},
+                              {"name" : "B", "executable" : create_script("b.sh", "touch B.done"), "depends_on" : ["A"]},
+                              {"name" : "C", "executable" : create_script("c.sh", "touch C.done")}],
+                             num_cpu = 2)
+            job_manager = JobManager()
+            exit_status, error_msg = job_manager.runJobs()
+
+            self.assertEqual(exit_status, 128 + 9)
+            self.assertIn("signal", error_msg)
+            self.assertFalse(os.path.exists("B.done"))
+            self.assertFalse(os.path.exists("C.done"))
+            self.assertTrue(os.path.isfile(JobManager.EXIT_file))
+
+            with open(JobManager.RESOURCE_file) as f:
+                record = json.loads(f.readline())
+            self.assertEqual(record["job"], "A")
+            self.assertEqual(record["exit_status"], 128 + 9)
+
+
+    def test_run_job_signalled(self):
+        with TestAreaContext("job_manager/run_job_signalled"):
+            create_jobs_json([{"name" : "A", "executable" : create_script("a.sh", "kill -9 $$")}])
+            job_manager = JobManager()
+            exit_status, error_msg = job_manager.runJob(job_manager[0])
+            self.assertEqual(exit_status, 128 + 9)
+
+
+    def test_unknown_exit_status(self):
+        with TestAreaContext("job_manager/unknown_status"):
+            create_jobs_json([{"name" : "A", "executable" : create_script("a.sh", "true")}])
+            job_manager = JobManager()
+            child = ChildExit(12345, None, None, False, error="exit status unknown")
+            exit_status, error_msg = job_manager._exitStatus(job_manager[0], child)
+            self.assertEqual(exit_status, -1)
+            self.assertIn("exit status unknown", error_msg)
+
+
+    def test_timed_out_job_record(self):
+        with TestAreaContext("job_manager/timed_out"):
+            create_jobs_json([{"name" : "A", "executable" : create_script("a.sh", "sleep 60"), "max_running_minutes" : 0.01}])
+            job_manager = JobManager()
+            exit_status, error_msg = job_manager.runJobs()
+            self.assertEqual(exit_status, -1)
+
+            with open(JobManager.RESOURCE_file) as f:
+                record = json.loads(f.readline())
+            self.assertEqual(record["job"], "A")
+            self.assertEqual(record["exit_status"], -1)
+            self.assertTrue(record["timed_out"])
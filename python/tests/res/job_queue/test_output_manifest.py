@@ -0,0 +1,97 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+import os
+
+from ecl.test import ExtendedTestCase, TestAreaContext
+from res.job_queue.output_manifest import MANIFEST_file, NO_CHECKSUM, declared_output_files, write_manifest, verify_manifest
+
+
+def write_file(path, content):
+    directory = os.path.dirname(path)
+    if directory and not os.path.isdir(directory):
+        os.makedirs(directory)
+    with open(path, "w") as f:
+        f.write(content)
+
+
+def read_manifest(path=MANIFEST_file):
+    manifest = {}
+    with open(path) as f:
+        for line in f:
+            checksum, size, file_name = line.rstrip("\n").split("  ", 2)
+            manifest[file_name] = (checksum, int(size))
+    return manifest
+
+
+class OutputManifestTest(ExtendedTestCase):
+
+    def test_declared_output_files(self):
+        job_list = [{"name" : "A", "target_file" : "a.txt"},
+                    {"name" : "B", "output_files" : ["b1.txt", "b2.txt"]},
+                    {"name" : "C", "target_file" : None, "output_files" : None}]
+        self.assertEqual(declared_output_files(job_list), ["a.txt", "b1.txt", "b2.txt"])
+
+
+    def test_round_trip(self):
+        with TestAreaContext("output_manifest/round_trip"):
+            run_path = os.getcwd()
+            write_file("declared.txt", "declared")
+            write_file("sub/other.txt", "other")
+            write_file("old.txt", "old")
+            os.utime("old.txt", (0, 0))
+            os.symlink("declared.txt", "link")
+
+            write_manifest(run_path, ["declared.txt", os.path.join(run_path, "sub/other.txt"), "missing.txt"], 1000)
+            manifest = read_manifest()
+
+            self.assertEqual(sorted(manifest.keys()), ["declared.txt", "sub/other.txt"])
+            self.assertNotEqual(manifest["declared.txt"][0], NO_CHECKSUM)
+            self.assertEqual(manifest["declared.txt"][1], len("declared"))
+            self.assertNotEqual(manifest["sub/other.txt"][0], NO_CHECKSUM)
+            self.assertEqual(verify_manifest(run_path), [])
+
+
+    def test_undeclared_files_without_checksum(self):
+        with TestAreaContext("output_manifest/undeclared"):
+            write_file("declared.txt", "declared")
+            write_file("output.txt", "output")
+            write_manifest(os.getcwd(), ["declared.txt"], 0)
+
+            manifest = read_manifest()
+            self.assertEqual(manifest["output.txt"], (NO_CHECKSUM, len("output")))
+            self.assertNotIn(MANIFEST_file, manifest)
+
+
+    def test_verify_errors(self):
+        with TestAreaContext("output_manifest/verify"):
+            run_path = os.getcwd()
+            self.assertEqual(len(verify_manifest(run_path)), 1)
+
+            write_file("checksum.txt", "abc")
+            write_file("size.txt", "abc")
+            write_file("missing.txt", "abc")
+            write_manifest(run_path, ["checksum.txt"], 0)
+
+            write_file("checksum.txt", "xyz")
+            write_file("size.txt", "abcdef")
+            os.unlink("missing.txt")
+
+            errors = verify_manifest(run_path)
+            self.assertEqual(len(errors), 3)
+            self.assertTrue(any("Checksum mismatch for:checksum.txt" in e for e in errors))
+            self.assertTrue(any("Size mismatch for:size.txt" in e for e in errors))
+            self.assertTrue(any("Missing file:missing.txt" in e for e in errors))
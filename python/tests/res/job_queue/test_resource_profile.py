@@ -0,0 +1,77 @@
+#  Copyright (C) 2017  Statoil ASA, Norway.
+#
+#  This file is part of ERT - Ensemble based Reservoir Tool.
+#
+#  ERT is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  ERT is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.
+#
+#  See the GNU General Public License at <http://www.gnu.org/licenses/gpl.html>
+#  for more details.
+
+import json
+import os
+
+from ecl.test import ExtendedTestCase, TestAreaContext
+from res.job_queue import JobManager, ResourceProfile
+
+
+class ResourceProfileTest(ExtendedTestCase):
+
+    def test_percentiles(self):
+        profile = ResourceProfile()
+        for wall in [7, 3, 10, 1, 5, 2, 9, 4, 8, 6]:
+            profile.addRecord({"job" : "SIM", "wall_s" : wall, "cpu_user_s" : wall / 2.0, "cpu_sys_s" : 0, "exit_status" : 0})
+
+        summary = profile.summary("SIM")
+        self.assertEqual(summary["count"], 10)
+        self.assertAlmostEqual(summary["wall_s"]["mean"], 5.5)
+        self.assertAlmostEqual(summary["wall_s"]["p50"], 5.5)
+        self.assertAlmostEqual(summary["wall_s"]["p90"], 9.1)
+        self.assertEqual(summary["wall_s"]["max"], 10)
+        self.assertAlmostEqual(summary["cpu_fraction"], 0.5)
+
+
+    def test_single_record(self):
+        profile = ResourceProfile()
+        profile.addRecord({"job" : "SIM", "wall_s" : 4.0})
+        summary = profile.summary("SIM")
+        self.assertEqual(summary["wall_s"]["p50"], 4.0)
+        self.assertEqual(summary["wall_s"]["p90"], 4.0)
+        self.assertNotIn("max_rss_kb", summary)
+
+
+    def test_failed_and_timed_out(self):
+        profile = ResourceProfile()
+        profile.addRecord({"job" : "SIM", "wall_s" : 1, "exit_status" : 0, "timed_out" : False})
+        profile.addRecord({"job" : "SIM", "wall_s" : 1, "exit_status" : 1, "timed_out" : False})
+        profile.addRecord({"job" : "SIM", "wall_s" : 1, "exit_status" : -1, "timed_out" : True})
+        profile.addRecord({"job" : "RMS", "wall_s" : 1, "exit_status" : 0})
+
+        self.assertEqual(profile.jobNames(), ["RMS", "SIM"])
+        self.assertEqual(len(profile), 4)
+        summary = profile.summary("SIM")
+        self.assertEqual(summary["failed"], 2)
+        self.assertEqual(summary["timed_out"], 1)
+
+
+    def test_load(self):
+        with TestAreaContext("resource_profile/load"):
+            for iens in range(3):
+                run_path = "realization-%d" % iens
+                os.makedirs(run_path)
+                with open(os.path.join(run_path, JobManager.RESOURCE_file), "w") as f:
+                    f.write(json.dumps({"job" : "SIM", "wall_s" : iens + 1}) + "\n")
+                    # A partial record from a killed job is ignored.
+                    f.write('{"job" : "SIM", "wal')
+            os.makedirs("realization-3")
+
+            profile = ResourceProfile.load("realization-*")
+            self.assertEqual(len(profile), 3)
+            self.assertIn("SIM", profile)
+            self.assertAlmostEqual(profile.summary("SIM")["wall_s"]["p50"], 2)
@@ -13,15 +13,19 @@ import os.path
 import socket
 import time
 import signal
-import random
-import subprocess
 import shutil
+import select
+import errno
+import fcntl
+import hashlib
+import json
+import threading
 
 OK_file               =  "OK"
 EXIT_file             =  "ERROR"
 STATUS_file           =  "STATUS"
-sleep_time            =  10           # Time to sleep before exiting the script - to let the disks sync up.
-short_sleep           =  2
+RESOURCE_file         =  "STATUS.jsonl"
+MANIFEST_file         =  "OUTPUT_MANIFEST"
 requested_hexversion  =  0x02070000
 
 
@@ -82,29 +86,168 @@ def exec_job(job , executable):
     os.execvp(executable , argList )
 
 
-def job_process(job , executable):
-    argList = [ executable ]
-    if job.get("argList"):
-        argList += job["argList"]
-
-    P = subprocess.Popen( argList ,
-                          stdin  = job.get("stdin"),
-                          stdout = job.get("stdout"),
-                          stderr = job.get("stderr"),
-                          env = job.get("environment") )
-
-    return P
-
-
-def kill_job_and_EXIT( job , P ):
+def kill_job_and_EXIT( job , pid ):
     dump_EXIT_file( job , "Job:%s has been running for more than %d minutes - explicitly killed.\n" % (job["name"] , job["max_running_minutes"]))
-    pgid = os.getpgid( P.pid )
+    pgid = os.getpgid( pid )
     os.killpg(pgid , signal.SIGKILL )
 
     # The os.killpg() will kill this script as well; including the sys.exit() to extra certain.
     sys.exit( 1 )
 
 
+# An exited child is a zombie until it is reaped, and its
+# /proc/<pid>/io - including the I/O of the descendants it has reaped
+# - can still be read. Returns None if the child is still running, or
+# /proc is not available.
+
+def proc_io_exited( pid ):
+    try:
+        with open("/proc/%d/stat" % pid) as f:
+            # The command name in field two can contain spaces.
+            if f.read().rsplit(")" , 1)[1].split()[0] != "Z":
+                return None
+
+        io = {}
+        with open("/proc/%d/io" % pid) as f:
+            for line in f:
+                (key , value) = line.split(":")
+                io[key.strip()] = int(value)
+        return io
+    except (IOError , IndexError , ValueError):
+        return None
+
+
+# Returns the resource record of one job run; a copy of
+# res.job_queue.job_manager.resource_record(), which this script can
+# not import (see fork_and_wait()) - keep the two in sync. The records
+# are aggregated per job type by res.job_queue.ResourceProfile. The I/O
+# bytes are from /proc/<pid>/io when available, otherwise from the
+# block counts in the rusage.
+
+def resource_record( job , start_time , end_time , exit_status , timed_out , rusage , io ):
+    record = {"job"         : job["name"],
+              "executable"  : job.get("executable"),
+              "node"        : socket.gethostname(),
+              "run_path"    : os.getcwd(),
+              "start_time"  : start_time,
+              "end_time"    : end_time,
+              "wall_s"      : end_time - start_time,
+              "exit_status" : exit_status,
+              "timed_out"   : timed_out}
+
+    if rusage is not None:
+        record.update({"cpu_user_s"         : rusage.ru_utime,
+                       "cpu_sys_s"          : rusage.ru_stime,
+                       "max_rss_kb"         : rusage.ru_maxrss,
+                       "read_bytes"         : rusage.ru_inblock * 512,
+                       "write_bytes"        : rusage.ru_oublock * 512,
+                       "vol_ctx_switches"   : rusage.ru_nvcsw,
+                       "invol_ctx_switches" : rusage.ru_nivcsw,
+                       "major_page_faults"  : rusage.ru_majflt})
+
+    if io is not None:
+        record.update({"read_bytes"  : io.get("read_bytes" , 0),
+                       "write_bytes" : io.get("write_bytes" , 0),
+                       "rchar"       : io.get("rchar" , 0),
+                       "wchar"       : io.get("wchar" , 0)})
+    return record
+
+
+# Appends the resource record of the job to the RESOURCE_file. A job
+# which has timed out is recorded with exit status -1, as in the
+# JobManager, and without rusage since it has not been reaped.
+
+def write_resource_record( job , start_time , exit_status , timed_out , rusage , io ):
+    if timed_out:
+        exit_code = -1
+    elif os.WIFSIGNALED( exit_status ):
+        exit_code = 128 + os.WTERMSIG( exit_status )
+    else:
+        exit_code = os.WEXITSTATUS( exit_status )
+
+    record = resource_record( job , start_time , time.time() , exit_code , timed_out , rusage , io )
+    fileH = open(RESOURCE_file , "a")
+    fileH.write( json.dumps( record , sort_keys = True ) + "\n" )
+    fileH.close()
+
+
+# Starts the job in a child process and waits for it to exit, or for
+# the timeout (in seconds, or None) to expire. Instead of polling, a
+# SIGCHLD handler writes to a pipe and the script sleeps in select()
+# on that pipe with the remaining time as timeout; i.e. both the exit
+# of the child and the timeout are handled without any delay. The
+# handler is installed before the fork so an immediate exit is not
+# lost. Returns (exit_status , timed_out , rusage , io); on timeout the
+# pid of the still running child is returned in place of the exit
+# status. The io is /proc/<pid>/io read from the exited child before it
+# is reaped, or None.
+#
+# This is the same self-pipe scheme as res.job_queue.ChildSupervisor;
+# it is repeated here because this script must run with the system
+# python, without the users environment, and can therefor not import
+# the res package. Changes to one should be made to the other. On a
+# timeout the child is killed by kill_job_and_EXIT(), through the
+# process group it shares with this script.
+
+def fork_and_wait( job , executable , timeout ):
+    (read_fd , write_fd) = os.pipe()
+    for fd in (read_fd , write_fd):
+        fcntl.fcntl( fd , fcntl.F_SETFL , fcntl.fcntl( fd , fcntl.F_GETFL ) | os.O_NONBLOCK )
+        fcntl.fcntl( fd , fcntl.F_SETFD , fcntl.fcntl( fd , fcntl.F_GETFD ) | fcntl.FD_CLOEXEC )
+
+    def wakeup( signum , frame ):
+        try:
+            os.write( write_fd , "x" )
+        except OSError:
+            pass   # The pipe is full; a wakeup is already pending.
+
+    # The license waiter threads can still be blocked in lockf(), and
+    # the SIGCHLD can be delivered to one of them; the wakeup fd is
+    # written by the C level handler whichever thread gets the signal.
+    old_handler = signal.signal( signal.SIGCHLD , wakeup )
+    old_wakeup_fd = signal.set_wakeup_fd( write_fd )
+    try:
+        pid = os.fork()
+        if pid == 0:
+            os.close( read_fd )
+            os.close( write_fd )
+            exec_job( job , executable )
+
+        deadline = None
+        if timeout:
+            deadline = time.time() + timeout
+
+        while True:
+            io = proc_io_exited( pid )
+            (return_pid , exit_status , rusage) = os.wait4( pid , os.WNOHANG )
+            if return_pid == pid:
+                return (exit_status , False , rusage , io)
+
+            remaining = None
+            if deadline is not None:
+                remaining = deadline - time.time()
+                if remaining <= 0:
+                    return (pid , True , None , None)
+
+            try:
+                select.select( [read_fd] , [] , [] , remaining )
+            except select.error:
+                if sys.exc_info()[1].args[0] != errno.EINTR:
+                    raise
+
+            try:
+                while os.read( read_fd , 4096 ):
+                    pass
+            except OSError:
+                pass
+    finally:
+        signal.set_wakeup_fd( old_wakeup_fd )
+        signal.signal( signal.SIGCHLD , old_handler or signal.SIG_DFL )
+        os.close( read_fd )
+        os.close( write_fd )
+
+
+
 def unlink_empty(file):
     if os.path.exists(file):
         st = os.stat( file )
@@ -118,8 +261,7 @@ def cleanup( job ):
         unlink_empty( job["stdout"] )
     if job.get("stderr"):
         unlink_empty( job["stderr"] )
-    if job.get("license_link"):
-        os.unlink(job["license_link"])
+    license_release( job )
 
 
 
@@ -131,53 +273,275 @@ def cleanup( job ):
 #  1. The job is initilized with a license_path and a max_running
 #     variable.
 #
-#  2. In the licens_path directory a license file is made.
+#  2. In the license_path directory there is a directory with one
+#     token file for each of the max_running seats, and a turnstile
+#     file which holds the number of the next ticket.
+#
+#  3. A job holds a seat by holding an exclusive fcntl() lock on one
+#     of the token files. The locks are released by the kernel (by
+#     the NFS lock manager on a shared filesystem) when the holder
+#     exits, also if it is killed; i.e. there are no stale seats to
+#     clean up.
 #
-#  3. For each instance a random hard-link is created to the license
-#     file - this is how the number of concurrent uses is counted.
+#  4. The waiters are served first come first served, also when a seat
+#     is free, so that a later job can never take a seat ahead of an
+#     earlier one. Under the turnstile lock a job takes the next ticket
+#     from the turnstile file, and locks the queue file q.<ticket>. It
+#     then waits in a blocking lock on q.<ticket - 1>, which the job
+#     before it holds until that job has got a seat (or has died).
 #
-#  4. When the external program is finished the hard link is removed.
+#  5. The job at the head of the queue takes a free seat if there is
+#     one; otherwise it waits for all the tokens at once, with one
+#     thread per token in a blocking lock. The first token granted is
+#     kept; a thread which is granted a token later releases it at
+#     once. The job then releases its queue file, and the next job
+#     becomes the head of the queue.
+#
+#     All the waits are blocking lock requests; there is no polling,
+#     and a seat is taken as soon as the lock manager grants it.
+#
+#  6. When the external program is finished the token is unlocked.
+
+
+# Returns an fd holding an exclusive lock on file_name, or None if
+# wait is False and the file is locked by another process.
+
+def license_lock( file_name , wait ):
+    fd = os.open( file_name , os.O_RDWR | os.O_CREAT , 0644 )
+    fcntl.fcntl( fd , fcntl.F_SETFD , fcntl.fcntl( fd , fcntl.F_GETFD ) | fcntl.FD_CLOEXEC )
+    flags = fcntl.LOCK_EX
+    if not wait:
+        flags = flags | fcntl.LOCK_NB
+
+    while True:
+        try:
+            fcntl.lockf( fd , flags )
+            return fd
+        except IOError:
+            error = sys.exc_info()[1]
+            if error.errno != errno.EINTR:
+                os.close( fd )
+                if error.errno not in (errno.EACCES , errno.EAGAIN):
+                    raise error
+                return None
+
+
+def license_probe( token_path , max_running ):
+    for token in range( max_running ):
+        fd = license_lock( "%s/%d" % (token_path , token) , False )
+        if fd is not None:
+            return fd
+    return None
+
+
+# Takes the next ticket from the turnstile file, and returns the
+# ticket and an fd holding the lock on the queue file of the ticket.
+# The counter is only read and written under the lock, which is also
+# what makes the content coherent between NFS clients.
+
+def license_take_ticket( token_path ):
+    turnstile_fd = license_lock( "%s/turnstile" % token_path , True )
+    try:
+        os.lseek( turnstile_fd , 0 , os.SEEK_SET )
+        content = os.read( turnstile_fd , 64 ).strip()
+        ticket = 0
+        if content:
+            ticket = int( content )
+
+        queue_fd = license_lock( "%s/q.%d" % (token_path , ticket) , True )
+        os.lseek( turnstile_fd , 0 , os.SEEK_SET )
+        os.ftruncate( turnstile_fd , 0 )
+        os.write( turnstile_fd , "%d\n" % (ticket + 1) )
+        return ticket , queue_fd
+    finally:
+        os.close( turnstile_fd )
+
+
+def license_wait_predecessor( token_path , ticket ):
+    if ticket > 0:
+        queue_file = "%s/q.%d" % (token_path , ticket - 1)
+        os.close( license_lock( queue_file , True ) )
+        # Only this job waits for the predecessor's queue file.
+        try:
+            os.unlink( queue_file )
+        except OSError:
+            pass
+
+
+def license_wait_token( token_file , winner , wakeup_fd ):
+    fd = license_lock( token_file , True )
+    with winner["lock"]:
+        if winner["fd"] is None:
+            winner["fd"] = fd
+            os.write( wakeup_fd , "x" )
+            return
+    os.close( fd )
+
+
+def license_wait_any( token_path , max_running ):
+    read_fd , write_fd = os.pipe()
+    for fd in (read_fd , write_fd):
+        fcntl.fcntl( fd , fcntl.F_SETFD , fcntl.fcntl( fd , fcntl.F_GETFD ) | fcntl.FD_CLOEXEC )
+
+    winner = {"lock" : threading.Lock() , "fd" : None}
+    for token in range( max_running ):
+        thread = threading.Thread( target = license_wait_token ,
+                                   args = ("%s/%d" % (token_path , token) , winner , write_fd) )
+        thread.daemon = True
+        thread.start()
+
+    while True:
+        try:
+            os.read( read_fd , 1 )
+            break
+        except OSError:
+            if sys.exc_info()[1].errno != errno.EINTR:
+                raise
+
+    # The write end is left open for the threads still waiting; they
+    # do not write to it, and it is closed when the process exits.
+    os.close( read_fd )
+    return winner["fd"]
 
 
 def license_check( job ):
-    job["license_link"] = None
+    job["license_fd"] = None
     if job.has_key("max_running"):
         if job["max_running"]:
-            job["license_file"] = "%s/%s" % (job["license_path"] , job["name"])
-            max_running         = job["max_running"]
-            license_file        = job["license_file"]
-            while True:
-                job["license_link"] = "%s/%d" % (job["license_path"] , random.randint(100000,999999))
-                if not os.path.exists(job["license_link"]):
-                    break
-
-
-            if not os.path.exists(license_file):
-                fileH = open(license_file , "w")
-                fileH.write("This is a license file for job:%s" % job["name"])
-                fileH.close()
+            max_running = job["max_running"]
+            token_path  = "%s/%s.tokens" % (job["license_path"] , job["name"])
+            if not os.path.isdir( token_path ):
+                try:
+                    os.makedirs( token_path )
+                except OSError:
+                    # Created by a concurrent job.
+                    if not os.path.isdir( token_path ):
+                        raise
+
+            ticket , queue_fd = license_take_ticket( token_path )
+            try:
+                license_wait_predecessor( token_path , ticket )
+                job["license_fd"] = license_probe( token_path , max_running )
+                if job["license_fd"] is None:
+                    job["license_fd"] = license_wait_any( token_path , max_running )
+            finally:
+                os.close( queue_fd )
+
+
+def license_release( job ):
+    if job.get("license_fd") is not None:
+        os.close( job["license_fd"] )
+        job["license_fd"] = None
+
+
+
+# Instead of sleeping to let the disks sync up before the OK file is
+# written, all files written during the run are fsync'ed and listed
+# in a manifest, and the manifest and the OK file are written via a
+# temporary file which is fsync'ed and renamed. The manifest has one
+# line per file: "<md5 or ->  <size>  <path>"; the md5 checksum is only
+# computed for the declared output files, i.e. target_file and
+# output_files of the jobs. The manifest can be verified with
+# res.job_queue.output_manifest.verify_manifest(); the result loader
+# in libres does not do that yet.
+#
+# The functions below are a copy of res/job_queue/output_manifest.py,
+# which this script can not import (see fork_and_wait()); keep the two
+# in sync.
 
+NO_CHECKSUM = "-"
 
-            stat_info = os.stat(license_file)
-            currently_running = stat_info[3] - 1
 
-            while True:
-                stat_info = os.stat(license_file)
-                currently_running = stat_info[3] - 1
-                if currently_running < max_running:
-                    break
-                else:
-                    time.sleep(5)
+def fsync_file( path ):
+    fd = os.open( path , os.O_RDONLY )
+    try:
+        os.fsync( fd )
+    finally:
+        os.close( fd )
 
-            os.link(license_file , job["license_link"])
 
-            while True:
-                stat_info = os.stat(license_file)
-                currently_running = stat_info[3] - 1
-                if currently_running <= max_running:
-                    break # OK - now we can leave the building - and let the job start
-                else:
-                    time.sleep(5)
+def fsync_directory( path ):
+    fd = os.open( path , os.O_RDONLY )
+    try:
+        os.fsync( fd )
+    except OSError:
+        # Not all filesystems support fsync() on directories.
+        pass
+    finally:
+        os.close( fd )
+
+
+def file_checksum( path , block_size = 1024 * 1024 ):
+    md5 = hashlib.md5()
+    with open( path , "rb" ) as f:
+        while True:
+            block = f.read( block_size )
+            if not block:
+                break
+            md5.update( block )
+    return md5.hexdigest()
+
+
+def write_durable( path , content ):
+    tmp_path = "%s.tmp" % path
+    with open( tmp_path , "w" ) as f:
+        f.write( content )
+        f.flush()
+        os.fsync( f.fileno() )
+    os.rename( tmp_path , path )
+    fsync_directory( os.path.dirname( os.path.abspath( path )))
+
+
+def declared_output_files( job_list ):
+    files = []
+    for job in job_list:
+        if job.get("target_file"):
+            files.append( job["target_file"] )
+        for output_file in job.get("output_files") or []:
+            files.append( output_file )
+    return files
+
+
+def written_files( run_path , start_time , skip ):
+    files = []
+    for (dirpath , dirnames , filenames) in os.walk( run_path ):
+        for filename in filenames:
+            full_path = os.path.join( dirpath , filename )
+            rel_path = os.path.relpath( full_path , run_path )
+            if rel_path in skip or os.path.islink( full_path ) or not os.path.isfile( full_path ):
+                continue
+            if os.path.getmtime( full_path ) >= start_time:
+                files.append( rel_path )
+    return files
+
+
+def write_manifest( run_path , declared_files , start_time , manifest_file = MANIFEST_file ):
+    declared = set()
+    for path in declared_files:
+        if os.path.isabs( path ):
+            path = os.path.relpath( path , run_path )
+        if os.path.isfile( os.path.join( run_path , path )):
+            declared.add( os.path.normpath( path ))
+
+    skip = set([ manifest_file , "%s.tmp" % manifest_file ])
+    files = sorted( declared.union( written_files( run_path , start_time , skip )))
+    directories = set()
+    lines = []
+    for path in files:
+        full_path = os.path.join( run_path , path )
+        fsync_file( full_path )
+        directories.add( os.path.dirname( full_path ))
+
+        if path in declared:
+            checksum = file_checksum( full_path )
+        else:
+            checksum = NO_CHECKSUM
+        lines.append( "%s  %d  %s\n" % (checksum , os.path.getsize( full_path ) , path))
+
+    for directory in directories:
+        fsync_directory( directory )
+
+    write_durable( os.path.join( run_path , manifest_file ) , "".join( lines ))
 
 
 
@@ -247,6 +611,14 @@ def waitForTargetFile(target_file , stat_start_time):
 
 def run_one(job):
     license_check( job )
+    try:
+        return run_licensed( job )
+    finally:
+        license_release( job )
+
+
+
+def run_licensed(job):
     if job.get("stdin"):
         if not os.path.exists(job["stdin"]):
             return False , 0 , "Could not locate stdin file: %s" % job["stdin"]
@@ -278,27 +650,16 @@ def run_one(job):
             stat_start_time  = stat.st_mtime - 1
 
 
+    timeout = None
     if job.get("max_running_minutes"):
-        P = job_process( job , executable)
-        while True:
-            time.sleep( short_sleep )
-            run_time = time.time() - start_time
-            poll = P.poll()
-            if poll is None:
-                # Still running
-                if run_time > job["max_running_minutes"] * 60:
-                    # Have been running to long - kill it
-                    kill_job_and_EXIT( job , P )
-            else:
-                # Have completed within the time limits
-                break
-        exit_status = 0  # NOOOT properly used
-    else:
-        pid = os.fork()
-        if pid == 0:
-            exec_job(job  , executable)
-        else:
-            (return_pid , exit_status) = os.waitpid(pid , 0)
+        timeout = job["max_running_minutes"] * 60
+
+    (exit_status , timed_out , rusage , io) = fork_and_wait( job , executable , timeout )
+    write_resource_record( job , start_time , exit_status , timed_out , rusage , io )
+    if timed_out:
+        # Have been running to long - kill it; the os.killpg() does
+        # not return, so the resource record is written first.
+        kill_job_and_EXIT( job , exit_status )
 
 
     # Check success of job; look for both target_file and
@@ -354,11 +715,15 @@ if __name__ == '__main__':
         OK_file     = options.get("OK_file"     , OK_file )
         EXIT_file   = options.get("EXIT_file"   , EXIT_file )
         STATUS_file = options.get("STATUS_file" , STATUS_file )
-        sleep_time  = options.get("sleep_time"  , sleep_time )
+        if "sleep_time" in options:
+            sys.stderr.write("Warning: the sleep_time option is ignored - the output files are fsync'ed and listed in %s instead\n" % MANIFEST_file)
 
+    # Whole seconds, the mtime resolution of some filesystems.
+    run_start = int( time.time() )
     cond_unlink("EXIT")
     cond_unlink(EXIT_file)
     cond_unlink(STATUS_file)
+    cond_unlink(RESOURCE_file)
     cond_unlink(OK_file)
 
     fileH = open(STATUS_file , "a")
@@ -366,13 +731,15 @@ if __name__ == '__main__':
     fileH.close()
 
 
-    random.seed()
-
     for job in jobs.jobList:
         # To ensure compatibility with old versions.
         if not job.has_key("max_running_minutes"):
             job["max_running_minutes"] = None
 
+        # The concurrent scheduler is only in res.job_queue.JobManager.runJobs().
+        if job.get("depends_on") or job.get("parallel_group"):
+            sys.stderr.write("Warning: job:%s - depends_on and parallel_group are ignored, the jobs run in order\n" % job["name"])
+
 
     if len(sys.argv) <= 2:
         # Normal batch run.
@@ -396,10 +763,8 @@ if __name__ == '__main__':
 
 
         if OK:
-            fileH = open("OK" , "w")
-            fileH.write("All jobs complete")
-            fileH.close()
-            time.sleep( sleep_time )   # Let the disks sync up
+            write_manifest( os.getcwd() , declared_output_files( jobs.jobList ) , run_start )
+            write_durable( OK_file , "All jobs complete" )
     else:
         #Interactive run
         jobHash = {}